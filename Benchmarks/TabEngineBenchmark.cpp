@@ -0,0 +1,296 @@
+#include "TabEngine.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <vector>
+
+//==============================================================================
+// Timings for the TabEngine work that has to stay fast on long tabs: column
+// edits, loading, retuning, plugin state, text export and how the threaded
+// parts scale with cores. Build it in Release and run it with no arguments;
+// each figure is the median of several runs.
+//
+// Every allocation goes through the counters below, so the loading figures can
+// say how many allocations a load costs as well as how long it takes.
+static std::atomic<size_t> numAllocations { 0 };
+
+void* operator new(size_t size)
+{
+    ++numAllocations;
+
+    if (auto* memory = std::malloc(size == 0 ? 1 : size))
+        return memory;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)                 { return operator new(size); }
+void operator delete(void* memory) noexcept        { std::free(memory); }
+void operator delete[](void* memory) noexcept      { std::free(memory); }
+void operator delete(void* memory, size_t) noexcept   { std::free(memory); }
+void operator delete[](void* memory, size_t) noexcept { std::free(memory); }
+
+//==============================================================================
+static double medianMilliseconds(int runs, const std::function<void()>& job)
+{
+    std::vector<double> times;
+
+    for (int i = 0; i < runs; ++i)
+    {
+        auto start = juce::Time::getMillisecondCounterHiRes();
+        job();
+        times.push_back(juce::Time::getMillisecondCounterHiRes() - start);
+    }
+
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+// Notes on most columns at random strings and frets, a technique now and
+// then and a bar line every 16 columns, so that columns rarely repeat the way
+// they would in a tab that was filled in by hand
+static void fillPart(TabEngine& engine, int numColumns)
+{
+    // Each part gets its own notes, which the state format can't share
+    static juce::int64 nextSeed = 1;
+    juce::Random random(nextSeed++);
+
+    TabEngine::ScopedTransaction transaction(engine);
+    engine.setNumColumns(numColumns);
+
+    for (int col = 0; col < numColumns; ++col)
+    {
+        if (col % 16 == 0)
+            engine.insertBarLine(col);
+
+        if (random.nextInt(10) < 6)
+        {
+            int stringIndex = random.nextInt(engine.getNumStrings());
+            engine.setFret(col, stringIndex, random.nextInt(20));
+
+            if (random.nextInt(8) == 0)
+                engine.setTechnique(col, stringIndex, Technique::HammerOn);
+        }
+    }
+
+    // The edits above are history the figures shouldn't pay for
+    engine.clearUndoHistory();
+}
+
+static void fillDocument(TabEngine& engine, int numSections, int numParts, int numColumns)
+{
+    for (int s = 0; s < numSections; ++s)
+    {
+        if (s > 0)
+            engine.addSection("Section " + juce::String(s + 1));
+
+        engine.setCurrentSection(s);
+
+        for (int p = 0; p < numParts; ++p)
+        {
+            if (p > 0)
+                engine.addPart("Part " + juce::String(p + 1));
+
+            engine.setCurrentPart(p);
+            fillPart(engine, numColumns);
+        }
+    }
+
+    engine.setCurrentSection(0);
+}
+
+static int countNotes(const TabEngine& engine)
+{
+    int numNotes = 0;
+
+    for (int col = 0; col < engine.getNumColumns(); ++col)
+        for (int s = 0; s < engine.getNumStrings(); ++s)
+            numNotes += engine.getFret(col, s) >= 0 ? 1 : 0;
+
+    return numNotes;
+}
+
+//==============================================================================
+// Inserting or deleting a column only moves the columns in its own chunk and
+// the start offsets of the chunks after it, so the cost should grow with the
+// number of chunks (a 64th of the columns) rather than with every column
+static void benchmarkColumnEdits()
+{
+    std::printf("Column edits (insert + delete in the middle of the part)\n");
+
+    for (int numColumns : { 1000, 10000, 100000, 1000000 })
+    {
+        TabEngine engine;
+        fillPart(engine, numColumns);
+
+        const int numEdits = 1000;
+        auto ms = medianMilliseconds(5, [&]
+        {
+            for (int i = 0; i < numEdits; ++i)
+            {
+                engine.insertColumn(numColumns / 2);
+                engine.deleteColumn(numColumns / 2);
+            }
+        });
+
+        std::printf("  %8d columns: %7.3f us per edit\n", numColumns, ms * 1000.0 / (2 * numEdits));
+    }
+}
+
+// Loading builds every part's columns in one arena, so the allocation count
+// should follow the number of parts rather than the number of columns
+static void benchmarkLoading()
+{
+    std::printf("\nLoading (20 sections x 3 parts x 2000 columns)\n");
+
+    TabEngine source;
+    fillDocument(source, 20, 3, 2000);
+
+    auto xml = source.saveToXML();
+    juce::MemoryBlock state;
+    source.saveToBinary(state);
+
+    TabEngine engine;
+
+    auto before = numAllocations.load();
+    engine.loadFromXML(*xml);
+    auto xmlAllocations = numAllocations.load() - before;
+    auto xmlMs = medianMilliseconds(5, [&] { engine.loadFromXML(*xml); });
+
+    before = numAllocations.load();
+    engine.loadFromBinary(state.getData(), state.getSize());
+    auto stateAllocations = numAllocations.load() - before;
+    auto stateMs = medianMilliseconds(5, [&] { engine.loadFromBinary(state.getData(), state.getSize()); });
+
+    std::printf("  XML:    %8.2f ms, %7zu allocations, sections read on %d worker thread(s)\n", xmlMs, xmlAllocations,
+                juce::jmax(1, juce::SystemStats::getNumCpus() - 1));
+    std::printf("  binary: %8.2f ms, %7zu allocations\n", stateMs, stateAllocations);
+}
+
+// Retuning remaps every note through a table built once per tuning
+static void benchmarkRetuning()
+{
+    std::printf("\nRetuning (100000 columns)\n");
+
+    TabEngine engine;
+    fillPart(engine, 100000);
+    auto numNotes = countNotes(engine);
+
+    auto start = juce::Time::getMillisecondCounterHiRes();
+    auto numDropped = engine.setNumStrings(7);
+    auto stringsMs = juce::Time::getMillisecondCounterHiRes() - start;
+
+    start = juce::Time::getMillisecondCounterHiRes();
+    numDropped += engine.setRootNote("D");
+    auto rootMs = juce::Time::getMillisecondCounterHiRes() - start;
+
+    std::printf("  %d notes: 6 to 7 strings %.2f ms, new root %.2f ms, %d notes dropped\n",
+                numNotes, stringsMs, rootMs, numDropped);
+}
+
+// Binary state in each compression mode, against the legacy XML it replaced
+static void benchmarkState()
+{
+    std::printf("\nPlugin state (100 sections x 2 parts x 1000 columns)\n");
+
+    TabEngine engine;
+    fillDocument(engine, 100, 2, 1000);
+
+    auto snapshot = engine.getSnapshot();
+    auto xmlBytes = engine.saveToXML()->toString().getNumBytesAsUTF8();
+    std::printf("  XML     %9zu bytes\n", xmlBytes);
+
+    for (auto compression : { TabEngine::StateCompression::none, TabEngine::StateCompression::fast, TabEngine::StateCompression::small })
+    {
+        juce::MemoryBlock state;
+        auto saveMs = medianMilliseconds(5, [&] { TabEngine::saveToBinary(*snapshot, state, compression); });
+
+        TabEngine loaded;
+        auto loadMs = medianMilliseconds(5, [&] { loaded.loadFromBinary(state.getData(), state.getSize()); });
+
+        auto name = compression == TabEngine::StateCompression::none ? "none"
+                  : compression == TabEngine::StateCompression::fast ? "fast" : "small";
+
+        std::printf("  %-5s   %9zu bytes (%5.1fx smaller than XML), save %7.2f ms, load %7.2f ms\n",
+                    name, state.getSize(), (double)xmlBytes / (double)state.getSize(), saveMs, loadMs);
+    }
+}
+
+// Export renders each part once and keeps the text of unchanged parts, so a
+// second export should cost only the copying
+static void benchmarkExport()
+{
+    std::printf("\nText export (50000 columns)\n");
+
+    TabEngine engine;
+    fillPart(engine, 50000);
+
+    for (int wrapWidth : { 0, 80 })
+    {
+        juce::String text;
+        auto start = juce::Time::getMillisecondCounterHiRes();
+        text = engine.exportToText(wrapWidth);
+        auto firstMs = juce::Time::getMillisecondCounterHiRes() - start;
+
+        auto cachedMs = medianMilliseconds(5, [&] { text = engine.exportToText(wrapWidth); });
+
+        std::printf("  wrap %2d: %8.2f ms, again %7.2f ms, %d characters\n",
+                    wrapWidth, firstMs, cachedMs, text.length());
+    }
+}
+
+// Loading XML and rendering text spread sections and parts over the shared
+// worker threads. Each figure is run with the threads capped, so the rows show
+// how throughput grows with the number of cores.
+static void benchmarkScaling()
+{
+    std::printf("\nScaling (100 sections x 4 parts x 500 columns)\n");
+
+    TabEngine engine;
+    fillDocument(engine, 100, 4, 500);
+
+    auto snapshot = engine.getSnapshot();
+    auto xml = engine.saveToXML();
+    auto numColumns = 100.0 * 4 * 500;
+
+    TabEngine loaded;
+    int numCpus = juce::SystemStats::getNumCpus();
+
+    for (int numThreads = 1; ; numThreads = juce::jmin(numThreads * 2, numCpus))
+    {
+        TabEngine::setMaxThreads(numThreads);
+
+        auto loadMs = medianMilliseconds(5, [&] { loaded.loadFromXML(*xml); });
+        auto exportMs = medianMilliseconds(5, [&] { TabEngine::exportToText(*snapshot, 80); });
+
+        std::printf("  %2d thread(s): load %7.2f ms (%6.2f M columns/s), export %7.2f ms (%6.2f M columns/s)\n",
+                    numThreads, loadMs, numColumns / loadMs / 1000.0, exportMs, numColumns / exportMs / 1000.0);
+
+        if (numThreads >= numCpus)
+            break;
+    }
+
+    TabEngine::setMaxThreads(0);
+}
+
+//==============================================================================
+int main()
+{
+    // TabEngine's change notifications are posted to the message thread
+    juce::MessageManager::getInstance();
+
+    benchmarkColumnEdits();
+    benchmarkLoading();
+    benchmarkRetuning();
+    benchmarkState();
+    benchmarkExport();
+    benchmarkScaling();
+
+    // Stops the shared worker threads, as shutting JUCE down in a host would
+    juce::DeletedAtShutdown::deleteAll();
+    juce::MessageManager::deleteInstance();
+    return 0;
+}
@@ -23,10 +23,12 @@ KeyboardShortcutsPanel::KeyboardShortcutsPanel()
         {"Delete/Backspace", "Clear fret"},
         {"[", "Remove column"},
         {"]", "Add column"},
-        {"|", "Add bar line"}
+        {"|", "Add bar line"},
+        {"Cmd/Ctrl+Z", "Undo"},
+        {"Cmd/Ctrl+Y", "Redo"}
     };
 
-    setSize(280, 435);
+    setSize(280, 471);
 }
 
 KeyboardShortcutsPanel::~KeyboardShortcutsPanel()
@@ -1,6 +1,47 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
+//==============================================================================
+// Runs an import or export on a background thread behind a progress window
+// with a cancel button. The job is handed a progress callback that also tells
+// it when to stop; onComplete is called on the message thread afterwards.
+class FileTaskWindow : public juce::ThreadWithProgressWindow
+{
+public:
+    using Job = std::function<bool (const TabEngine::ProgressCallback&)>;
+    using Completion = std::function<void (bool succeeded, bool cancelled)>;
+
+    FileTaskWindow(const juce::String& title, juce::Component* parent, Job jobToRun, Completion completion)
+        : ThreadWithProgressWindow(title, true, true, 10000, {}, parent),
+          job(std::move(jobToRun)), onComplete(std::move(completion))
+    {
+    }
+
+    void run() override
+    {
+        succeeded = job([this](double progress)
+        {
+            setProgress(progress);
+            return !threadShouldExit();
+        });
+    }
+
+    void threadComplete(bool userPressedCancel) override
+    {
+        // The window is only deleted when the next task replaces it, so
+        // release whatever the job was holding on to now
+        job = nullptr;
+        onComplete(succeeded && !userPressedCancel, userPressedCancel);
+    }
+
+private:
+    Job job;
+    Completion onComplete;
+    bool succeeded = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FileTaskWindow)
+};
+
 //==============================================================================
 TabVSTAudioProcessorEditor::TabVSTAudioProcessorEditor (TabVSTAudioProcessor& p)
     : AudioProcessorEditor (&p), audioProcessor (p), tabEditor(p.getTabEngine())
@@ -11,10 +52,13 @@ TabVSTAudioProcessorEditor::TabVSTAudioProcessorEditor (TabVSTAudioProcessor& p)
 
     setupControls();
     syncUIWithEngine();
+
+    audioProcessor.getTabEngine().addListener(this);
 }
 
 TabVSTAudioProcessorEditor::~TabVSTAudioProcessorEditor()
 {
+    audioProcessor.getTabEngine().removeListener(this);
 }
 
 void TabVSTAudioProcessorEditor::setupControls()
@@ -53,6 +97,13 @@ void TabVSTAudioProcessorEditor::setupControls()
     tuningTypeSelector.addItem("Drop", 2);
     tuningTypeSelector.addItem("Open", 3);
     tuningTypeSelector.addItem("Custom", 4);
+
+    // Named tuning presets (IDs from 100), applied as a custom tuning
+    tuningTypeSelector.addSeparator();
+    tuningTypeSelector.addSectionHeading("Presets");
+    for (int i = 0; i < TuningTables::numNamed; ++i)
+        tuningTypeSelector.addItem(TuningTables::named[i].name, 100 + i);
+
     tuningTypeSelector.setSelectedId(1, juce::dontSendNotification);
     tuningTypeSelector.onChange = [this] { tuningTypeChanged(); };
 
@@ -77,6 +128,14 @@ void TabVSTAudioProcessorEditor::setupControls()
     importFileButton.onClick = [this] { importFromFile(); };
     importFileButton.setVisible(false); // Initially hidden (starts in editor mode)
 
+    // Wrap toggle - breaks the ASCII view into systems that fit its width
+    addAndMakeVisible(wrapButton);
+    wrapButton.setButtonText("Wrap");
+    wrapButton.setTooltip("Wrap lines to the width of the view");
+    wrapButton.setToggleState(true, juce::dontSendNotification);
+    wrapButton.onClick = [this] { updateAsciiView(); };
+    wrapButton.setVisible(false); // Initially hidden (starts in editor mode)
+
     // Clear button - removed, now available via right-click on sections
 
     // Add/Remove columns buttons removed - functionality moved to part right-click menu
@@ -87,15 +146,10 @@ void TabVSTAudioProcessorEditor::setupControls()
     modeButton.setTooltip("Toggle Editor/ASCII View");
     modeButton.onClick = [this] { toggleMode(); };
 
-    // ASCII view (hidden initially)
-    addAndMakeVisible(asciiView);
-    asciiView.setMultiLine(true);
-    asciiView.setReadOnly(true);
-    asciiView.setScrollbarsShown(true);
-    asciiView.setFont(juce::FontOptions(juce::Font::getDefaultMonospacedFontName(), 14.0f, juce::Font::plain));
-    asciiView.setColour(juce::TextEditor::backgroundColourId, juce::Colour(0xff1a1a1a));
-    asciiView.setColour(juce::TextEditor::textColourId, juce::Colours::lightgrey);
-    asciiView.setVisible(false);
+    // ASCII view with viewport for scrolling (hidden initially)
+    addAndMakeVisible(asciiViewport);
+    asciiViewport.setViewedComponent(&asciiView, false);
+    asciiViewport.setVisible(false);
 
     // Keyboard shortcuts button
     addAndMakeVisible(shortcutsButton);
@@ -183,6 +237,18 @@ void TabVSTAudioProcessorEditor::syncUIWithEngine()
     resized();
 }
 
+void TabVSTAudioProcessorEditor::tabDataChanged(const TabChange& change)
+{
+    // Undo and redo can change anything the controls show
+    if (change.has(TabChange::structureChanged) || change.has(TabChange::selectionChanged) || change.has(TabChange::tuningChanged))
+        syncUIWithEngine();
+
+    // The text doesn't show the selection, and the engine only renders the
+    // parts that changed, so the view can keep up with edits as they happen
+    if (!isEditorMode && (change.kinds & ~TabChange::selectionChanged) != 0)
+        updateAsciiView();
+}
+
 void TabVSTAudioProcessorEditor::paint (juce::Graphics& g)
 {
     g.fillAll(juce::Colour(0xff2a2a2a));
@@ -318,15 +384,17 @@ void TabVSTAudioProcessorEditor::resized()
         exportButton.setBounds(0, 0, 0, 0);
         exportFileButton.setBounds(0, 0, 0, 0);
         importFileButton.setBounds(0, 0, 0, 0);
+        wrapButton.setBounds(0, 0, 0, 0);
     }
     else
     {
         // In view mode: shortcuts button on left, action buttons on right
-        // Layout: [?] ... [Import] [Export] [Copy Tab]
+        // Layout: [?] ... [Wrap] [Import] [Export] [Copy Tab]
         helpBar.removeFromRight(20); // Padding from edge
         exportButton.setBounds(helpBar.removeFromRight(85));
         exportFileButton.setBounds(helpBar.removeFromRight(75));
         importFileButton.setBounds(helpBar.removeFromRight(75));
+        wrapButton.setBounds(helpBar.removeFromRight(70).withTrimmedLeft(10));
 
         helpBar.removeFromLeft(10);
         shortcutsButton.setBounds(helpBar.removeFromLeft(30).withTrimmedRight(5));
@@ -345,19 +413,24 @@ void TabVSTAudioProcessorEditor::resized()
     if (isEditorMode)
     {
         tabEditorViewport.setBounds(bounds.reduced(10));
-        asciiView.setBounds(0, 0, 0, 0); // Hide
+        asciiViewport.setBounds(0, 0, 0, 0); // Hide
     }
     else
     {
-        asciiView.setBounds(bounds.reduced(10));
+        asciiViewport.setBounds(bounds.reduced(10));
         tabEditorViewport.setBounds(0, 0, 0, 0); // Hide
+
+        // Rewrap for the new width. Parts that haven't changed keep their
+        // measurements, so this only costs the layout and the text.
+        if (getAsciiWrapWidth() != asciiWrapWidth)
+            updateAsciiView();
     }
 }
 
 void TabVSTAudioProcessorEditor::stringsChanged()
 {
     int numStrings = stringsSelector.getSelectedId();
-    audioProcessor.getTabEngine().setNumStrings(numStrings);
+    reportDroppedNotes(audioProcessor.getTabEngine().setNumStrings(numStrings));
     updateCustomTuningControls();
     resized();
 }
@@ -370,7 +443,7 @@ void TabVSTAudioProcessorEditor::keyChanged()
     if (selectedId > 0 && selectedId <= orderedNotes.size())
     {
         juce::String selectedNote = orderedNotes[selectedId - 1];
-        audioProcessor.getTabEngine().setRootNote(selectedNote);
+        reportDroppedNotes(audioProcessor.getTabEngine().setRootNote(selectedNote));
     }
 }
 
@@ -379,6 +452,13 @@ void TabVSTAudioProcessorEditor::tuningTypeChanged()
     int typeId = tuningTypeSelector.getSelectedId();
     TuningType type = TuningType::Standard;
 
+    if (typeId >= 100)
+    {
+        reportDroppedNotes(audioProcessor.getTabEngine().applyNamedTuning(typeId - 100));
+        syncUIWithEngine(); // Shows the preset as Custom with its string count
+        return;
+    }
+
     switch (typeId)
     {
         case 1: type = TuningType::Standard; break;
@@ -387,7 +467,7 @@ void TabVSTAudioProcessorEditor::tuningTypeChanged()
         case 4: type = TuningType::Custom; break;
     }
 
-    audioProcessor.getTabEngine().setTuningType(type);
+    reportDroppedNotes(audioProcessor.getTabEngine().setTuningType(type));
     updateCustomTuningControls();
     resized();
 }
@@ -402,11 +482,23 @@ void TabVSTAudioProcessorEditor::customStringNoteChanged(int stringIndex)
             int noteIndex = selector->getSelectedId() - 1;
             auto notes = NoteUtils::getAllNotes();
             if (noteIndex >= 0 && noteIndex < notes.size())
-                audioProcessor.getTabEngine().setCustomStringNote(stringIndex, notes[noteIndex]);
+                reportDroppedNotes(audioProcessor.getTabEngine().setCustomStringNote(stringIndex, notes[noteIndex]));
         }
     }
 }
 
+void TabVSTAudioProcessorEditor::reportDroppedNotes(int numDropped)
+{
+    if (numDropped <= 0)
+        return;
+
+    juce::NativeMessageBox::showMessageBoxAsync(
+        juce::MessageBoxIconType::WarningIcon,
+        "Notes Removed",
+        numDropped == 1 ? juce::String("1 note had no free string in the new tuning and was removed. Undo to bring it back.")
+                        : juce::String(numDropped) + " notes had no free string in the new tuning and were removed. Undo to bring them back.");
+}
+
 void TabVSTAudioProcessorEditor::updateCustomTuningControls()
 {
     bool isCustom = (tuningTypeSelector.getSelectedId() == 4);
@@ -463,7 +555,8 @@ void TabVSTAudioProcessorEditor::updateCustomTuningControls()
 
 void TabVSTAudioProcessorEditor::exportToClipboard()
 {
-    juce::String tabText = audioProcessor.getTabEngine().exportToText();
+    // Same wrapping as the ASCII view, so what's copied is what's shown
+    juce::String tabText = audioProcessor.getTabEngine().exportToText(getAsciiWrapWidth());
     juce::SystemClipboard::copyTextToClipboard(tabText);
 
     // Show confirmation
@@ -487,24 +580,43 @@ void TabVSTAudioProcessorEditor::exportToFile()
         auto file = chooser.getResult();
         if (file != juce::File())
         {
-            // Get XML from TabEngine
-            auto xml = audioProcessor.getTabEngine().saveToXML();
-
-            // Write to file
-            if (xml->writeTo(file))
-            {
-                juce::NativeMessageBox::showMessageBoxAsync(
-                    juce::MessageBoxIconType::InfoIcon,
-                    "Exported",
-                    "Tab exported successfully to:\n" + file.getFullPathName());
-            }
-            else
-            {
-                juce::NativeMessageBox::showMessageBoxAsync(
-                    juce::MessageBoxIconType::WarningIcon,
-                    "Export Failed",
-                    "Failed to write file:\n" + file.getFullPathName());
-            }
+            // Write the indexed container from a snapshot, so editing can
+            // carry on while it is saved. The engine only lets go of the
+            // file it was opened from, which could be the one being saved
+            // over, once the new file is written.
+            auto save = audioProcessor.getTabEngine().prepareSave(file);
+
+            runFileTask("Exporting Tab",
+                [save](const TabEngine::ProgressCallback& progress)
+                {
+                    return save->write(progress);
+                },
+                [this, save, file](bool succeeded, bool cancelled)
+                {
+                    succeeded = succeeded && audioProcessor.getTabEngine().finishSave(*save);
+
+                    if (succeeded)
+                    {
+                        int numUnreadable = save->getNumUnreadableSections();
+                        juce::String message = "Tab exported successfully to:\n" + file.getFullPathName();
+
+                        if (numUnreadable > 0)
+                            message << "\n\n" << numUnreadable << (numUnreadable == 1 ? " section" : " sections")
+                                    << " couldn't be read and kept the data they were opened with.";
+
+                        juce::NativeMessageBox::showMessageBoxAsync(
+                            numUnreadable > 0 ? juce::MessageBoxIconType::WarningIcon : juce::MessageBoxIconType::InfoIcon,
+                            "Exported",
+                            message);
+                    }
+                    else if (!cancelled)
+                    {
+                        juce::NativeMessageBox::showMessageBoxAsync(
+                            juce::MessageBoxIconType::WarningIcon,
+                            "Export Failed",
+                            "Failed to write file:\n" + file.getFullPathName());
+                    }
+                });
         }
     });
 }
@@ -523,38 +635,61 @@ void TabVSTAudioProcessorEditor::importFromFile()
         auto file = chooser.getResult();
         if (file != juce::File())
         {
-            // Parse XML from file
-            auto xml = juce::parseXML(file);
-
-            if (xml != nullptr)
-            {
-                // Load into TabEngine
-                audioProcessor.getTabEngine().loadFromXML(*xml);
-
-                // Update UI
-                syncUIWithEngine();
-                tabEditor.repaint();
+            // The new document is built on the background thread and only
+            // swapped into the TabEngine once it has been read completely
+            auto loaded = std::make_shared<std::shared_ptr<TabDocument>>();
 
-                // Update ASCII view if in view mode
-                if (!isEditorMode)
-                    updateAsciiView();
-
-                juce::NativeMessageBox::showMessageBoxAsync(
-                    juce::MessageBoxIconType::InfoIcon,
-                    "Imported",
-                    "Tab imported successfully from:\n" + file.getFullPathName());
-            }
-            else
-            {
-                juce::NativeMessageBox::showMessageBoxAsync(
-                    juce::MessageBoxIconType::WarningIcon,
-                    "Import Failed",
-                    "Failed to parse file:\n" + file.getFullPathName());
-            }
+            runFileTask("Importing Tab",
+                [loaded, file](const TabEngine::ProgressCallback& progress)
+                {
+                    *loaded = TabEngine::readFile(file, progress);
+                    return *loaded != nullptr;
+                },
+                [this, loaded, file](bool succeeded, bool cancelled)
+                {
+                    if (succeeded)
+                    {
+                        audioProcessor.getTabEngine().loadDocument(std::move(*loaded));
+
+                        // Update UI
+                        syncUIWithEngine();
+                        tabEditor.repaint();
+
+                        // Update ASCII view if in view mode
+                        if (!isEditorMode)
+                            updateAsciiView();
+
+                        juce::NativeMessageBox::showMessageBoxAsync(
+                            juce::MessageBoxIconType::InfoIcon,
+                            "Imported",
+                            "Tab imported successfully from:\n" + file.getFullPathName());
+
+                        reportUnreadableSection(audioProcessor.getTabEngine().getCurrentSection());
+                    }
+                    else if (!cancelled)
+                    {
+                        juce::NativeMessageBox::showMessageBoxAsync(
+                            juce::MessageBoxIconType::WarningIcon,
+                            "Import Failed",
+                            "Failed to parse file:\n" + file.getFullPathName());
+                    }
+                });
         }
     });
 }
 
+void TabVSTAudioProcessorEditor::runFileTask(const juce::String& title,
+                                             std::function<bool (const TabEngine::ProgressCallback&)> job,
+                                             std::function<void (bool succeeded, bool cancelled)> onComplete)
+{
+    // One file task at a time
+    if (fileTask != nullptr && fileTask->isThreadRunning())
+        return;
+
+    fileTask = std::make_unique<FileTaskWindow>(title, this, std::move(job), std::move(onComplete));
+    fileTask->launchThread();
+}
+
 void TabVSTAudioProcessorEditor::addColumn()
 {
     // Add 1 column after cursor position
@@ -618,10 +753,11 @@ void TabVSTAudioProcessorEditor::toggleMode()
     {
         modeButton.setButtonText("View Tab");
         tabEditorViewport.setVisible(true);
-        asciiView.setVisible(false);
+        asciiViewport.setVisible(false);
         exportButton.setVisible(false); // Hide buttons in editor mode
         exportFileButton.setVisible(false);
         importFileButton.setVisible(false);
+        wrapButton.setVisible(false);
 
         // Enable all edit controls
         stringsSelector.setEnabled(true);
@@ -647,12 +783,12 @@ void TabVSTAudioProcessorEditor::toggleMode()
     else
     {
         modeButton.setButtonText("Edit Tab");
-        updateAsciiView();
         tabEditorViewport.setVisible(false);
-        asciiView.setVisible(true);
+        asciiViewport.setVisible(true);
         exportButton.setVisible(true); // Show buttons in view mode
         exportFileButton.setVisible(true);
         importFileButton.setVisible(true);
+        wrapButton.setVisible(true);
 
         // Disable all edit controls
         stringsSelector.setEnabled(false);
@@ -677,14 +813,30 @@ void TabVSTAudioProcessorEditor::toggleMode()
     }
 
     resized();
+
+    // The text is only kept up to date in view mode. Laid out after resized()
+    // so it's wrapped to the viewport's real width.
+    if (!isEditorMode)
+        updateAsciiView();
 }
 
 void TabVSTAudioProcessorEditor::updateAsciiView()
 {
-    juce::String tabText = audioProcessor.getTabEngine().exportToText();
+    asciiWrapWidth = getAsciiWrapWidth();
+    juce::String tabText = audioProcessor.getTabEngine().exportToText(asciiWrapWidth);
     asciiView.setText(tabText);
 }
 
+int TabVSTAudioProcessorEditor::getAsciiWrapWidth() const
+{
+    if (!wrapButton.getToggleState())
+        return 0;
+
+    // Leave room for the vertical scroll bar, which most songs need
+    auto width = asciiViewport.getMaximumVisibleWidth() - asciiViewport.getScrollBarThickness();
+    return juce::jmax(1, asciiView.getNumColumnsFitting(width));
+}
+
 void TabVSTAudioProcessorEditor::updateSectionButtons()
 {
     // Clear existing section buttons
@@ -757,6 +909,22 @@ void TabVSTAudioProcessorEditor::sectionButtonClicked(int sectionIndex)
     updatePartButtons(); // Update part buttons when switching sections
     resized();
     tabEditor.repaint();
+
+    reportUnreadableSection(sectionIndex);
+}
+
+void TabVSTAudioProcessorEditor::reportUnreadableSection(int sectionIndex)
+{
+    auto& engine = audioProcessor.getTabEngine();
+
+    if (!engine.isSectionUnreadable(sectionIndex))
+        return;
+
+    juce::NativeMessageBox::showMessageBoxAsync(
+        juce::MessageBoxIconType::WarningIcon,
+        "Section Unreadable",
+        "The data for section \"" + engine.getSectionName(sectionIndex) + "\" couldn't be read, so it's shown empty. "
+        "Saving keeps the original data unless you edit the section.");
 }
 
 void TabVSTAudioProcessorEditor::sectionButtonDoubleClicked(int sectionIndex)
@@ -1079,7 +1247,7 @@ void TabVSTAudioProcessorEditor::clearPart(int partIndex)
 
 void TabVSTAudioProcessorEditor::copyPart(int partIndex)
 {
-    partClipboard = audioProcessor.getTabEngine().copyPartToXML(partIndex);
+    partClipboard = audioProcessor.getTabEngine().copyPart(partIndex);
     if (partClipboard)
     {
         juce::String partName = audioProcessor.getTabEngine().getPartName(partIndex);
@@ -1101,7 +1269,7 @@ void TabVSTAudioProcessorEditor::pastePart(int partIndex)
     {
         if (result == 1) // 1 = OK button
         {
-            audioProcessor.getTabEngine().pastePartFromXML(partIndex, *partClipboard);
+            audioProcessor.getTabEngine().pastePart(partIndex, partClipboard);
             updatePartButtons();
             resized();
             tabEditor.repaint();
@@ -1141,7 +1309,7 @@ void TabVSTAudioProcessorEditor::clearSection(int sectionIndex)
 
 void TabVSTAudioProcessorEditor::copySection(int sectionIndex)
 {
-    sectionClipboard = audioProcessor.getTabEngine().copySectionToXML(sectionIndex);
+    sectionClipboard = audioProcessor.getTabEngine().copySection(sectionIndex);
 
     if (sectionClipboard)
     {
@@ -1164,7 +1332,7 @@ void TabVSTAudioProcessorEditor::pasteSection(int sectionIndex)
     {
         if (result == 1) // 1 = OK button
         {
-            audioProcessor.getTabEngine().pasteSectionFromXML(sectionIndex, *sectionClipboard);
+            audioProcessor.getTabEngine().pasteSection(sectionIndex, *sectionClipboard);
             updatePartButtons(); // Update if this is current section
             resized();
             tabEditor.repaint();
@@ -3,10 +3,12 @@
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
 #include "TabEditorComponent.h"
+#include "TabTextViewer.h"
 #include "KeyboardShortcutsPanel.h"
 
 //==============================================================================
-class TabVSTAudioProcessorEditor : public juce::AudioProcessorEditor
+class TabVSTAudioProcessorEditor : public juce::AudioProcessorEditor,
+                                   public TabEngine::Listener
 {
 public:
     TabVSTAudioProcessorEditor (TabVSTAudioProcessor&);
@@ -17,6 +19,9 @@ public:
     void resized() override;
     void mouseDown(const juce::MouseEvent& event) override;
 
+    // TabEngine::Listener
+    void tabDataChanged(const TabChange& change) override;
+
 private:
     TabVSTAudioProcessor& audioProcessor;
 
@@ -41,10 +46,13 @@ private:
     juce::TextButton exportButton;
     juce::TextButton exportFileButton;
     juce::TextButton importFileButton;
+    juce::ToggleButton wrapButton;
     juce::TextButton addColumnsButton;
     juce::TextButton removeColumnsButton;
     juce::TextButton modeButton;
-    juce::TextEditor asciiView;
+    TabTextViewer asciiView;
+    juce::Viewport asciiViewport;
+    int asciiWrapWidth = 0; // Width the ASCII view's text was wrapped to
 
     // Keyboard shortcuts panel
     juce::TextButton shortcutsButton;
@@ -71,17 +79,23 @@ private:
     void keyChanged();
     void tuningTypeChanged();
     void customStringNoteChanged(int stringIndex);
+    void reportDroppedNotes(int numDropped);
     void updateCustomTuningControls();
     void exportToClipboard();
     void exportToFile();
     void importFromFile();
+    void runFileTask(const juce::String& title,
+                     std::function<bool (const TabEngine::ProgressCallback&)> job,
+                     std::function<void (bool succeeded, bool cancelled)> onComplete);
     void addColumn();
     void removeColumn();
     void addBarLine();
     void toggleMode();
     void updateAsciiView();
+    int getAsciiWrapWidth() const;
     void updateSectionButtons();
     void sectionButtonClicked(int sectionIndex);
+    void reportUnreadableSection(int sectionIndex);
     void sectionButtonDoubleClicked(int sectionIndex);
     void sectionButtonRightClicked(int sectionIndex);
     void addSection();
@@ -104,9 +118,14 @@ private:
 
     bool isEditorMode = true;
 
-    // Clipboard for section and part data
-    std::unique_ptr<juce::XmlElement> sectionClipboard;
-    std::unique_ptr<juce::XmlElement> partClipboard;
+    // Import or export running in the background, if any. Destroying it
+    // stops the thread, so it can't call back into a deleted editor.
+    std::unique_ptr<juce::ThreadWithProgressWindow> fileTask;
+
+    // Clipboard for section and part data. These share their columns with
+    // the document they were copied from.
+    std::shared_ptr<const TabSection> sectionClipboard;
+    std::shared_ptr<const TabPart> partClipboard;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TabVSTAudioProcessorEditor)
 };
@@ -12,6 +12,7 @@ TabVSTAudioProcessor::TabVSTAudioProcessor()
 
 TabVSTAudioProcessor::~TabVSTAudioProcessor()
 {
+    cancelPendingUpdate();
 }
 
 //==============================================================================
@@ -106,18 +107,75 @@ juce::AudioProcessorEditor* TabVSTAudioProcessor::createEditor()
 //==============================================================================
 void TabVSTAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // Save the tab data so it persists with the DAW project
-    auto xml = tabEngine.saveToXML();
-    copyXmlToBinary (*xml, destData);
+    const juce::ScopedLock sl (stateLock);
+
+    // Save the tab data so it persists with the DAW project. State that was
+    // never decoded can't have changed, so it goes back exactly as it came.
+    // Hosts keep copies of this in project files and undo histories, so it's
+    // compressed; the fast level gets nearly all of the size back.
+    if (pendingState.getSize() > 0)
+        destData = pendingState;
+    else
+        tabEngine.saveToBinary (destData, TabEngine::StateCompression::fast);
 }
 
 void TabVSTAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // Restore the tab data when loading a DAW project
-    std::unique_ptr<juce::XmlElement> xmlState (getXmlFromBinary (data, sizeInBytes));
+    const juce::ScopedLock sl (stateLock);
+
+    // Hosts may call this from any thread, while the message thread is in the
+    // middle of an edit, so the TabEngine is never touched here. The state is
+    // kept, and once the TabEngine is in use the message thread is asked to
+    // load it.
+    pendingState.replaceAll (data, (size_t) sizeInBytes);
+
+    if (tabEngineInUse)
+        triggerAsyncUpdate();
+}
+
+TabEngine& TabVSTAudioProcessor::getTabEngine()
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+
+    const juce::ScopedLock sl (stateLock);
+
+    tabEngineInUse = true;
+
+    if (pendingState.getSize() > 0)
+    {
+        restoreState (pendingState.getData(), pendingState.getSize());
+        pendingState.reset();
+    }
 
-    if (xmlState != nullptr)
+    return tabEngine;
+}
+
+void TabVSTAudioProcessor::handleAsyncUpdate()
+{
+    // Loads any state restored since the TabEngine came into use
+    getTabEngine();
+}
+
+void TabVSTAudioProcessor::restoreState (const void* data, size_t sizeInBytes)
+{
+    // Restore the tab data when loading a DAW project. Binary state may be
+    // compressed or not; projects saved before the binary format hold the
+    // state as XML.
+    bool loaded = false;
+
+    if (TabEngine::isBinaryState (data, sizeInBytes))
+    {
+        loaded = tabEngine.loadFromBinary (data, sizeInBytes);
+    }
+    else if (auto xmlState = getXmlFromBinary (data, (int) sizeInBytes))
+    {
         tabEngine.loadFromXML (*xmlState);
+        loaded = true;
+    }
+
+    // A restored project starts with a fresh history
+    if (loaded)
+        tabEngine.clearUndoHistory();
 }
 
 //==============================================================================
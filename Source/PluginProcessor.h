@@ -4,7 +4,8 @@
 #include "TabEngine.h"
 
 //==============================================================================
-class TabVSTAudioProcessor : public juce::AudioProcessor
+class TabVSTAudioProcessor : public juce::AudioProcessor,
+                             private juce::AsyncUpdater
 {
 public:
     //==============================================================================
@@ -43,11 +44,25 @@ public:
     void setStateInformation (const void* data, int sizeInBytes) override;
 
     //==============================================================================
-    TabEngine& getTabEngine() { return tabEngine; }
+    // Decodes any state the host restored on first use. Message thread only,
+    // as that's the only thread allowed to change the TabEngine.
+    TabEngine& getTabEngine();
 
 private:
     TabEngine tabEngine;
 
+    // State restored by the host that hasn't been decoded yet. Most instances
+    // in a session never have their editor opened, so the blob is kept as it
+    // is until something first asks for the TabEngine, and handed straight
+    // back if the host saves before then. State restored while the TabEngine
+    // is in use waits here too, until the message thread can load it.
+    juce::MemoryBlock pendingState;
+    bool tabEngineInUse = false;
+    juce::CriticalSection stateLock;
+
+    void restoreState (const void* data, size_t sizeInBytes);
+    void handleAsyncUpdate() override;
+
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TabVSTAudioProcessor)
 };
@@ -30,10 +30,15 @@ void TabEditorComponent::paint(juce::Graphics& g)
 
 void TabEditorComponent::drawGrid(juce::Graphics& g)
 {
-    auto tuning = tabEngine.getCurrentTuning();
+    const auto& tuning = tabEngine.getCurrentTuning();
     int numStrings = tabEngine.getNumStrings();
     int numColumns = tabEngine.getNumColumns();
 
+    // Only visit the columns that overlap the area being repainted
+    auto clip = g.getClipBounds();
+    int firstColumn = juce::jlimit(0, numColumns, (clip.getX() - stringNameWidth) / cellWidth - 1);
+    int lastColumn = juce::jlimit(0, numColumns, (clip.getRight() - stringNameWidth) / cellWidth + 1);
+
     // Draw string names
     g.setColour(juce::Colours::lightgrey);
     g.setFont(14.0f);
@@ -41,7 +46,7 @@ void TabEditorComponent::drawGrid(juce::Graphics& g)
     for (int str = 0; str < numStrings; ++str)
     {
         int y = str * cellHeight + 20;
-        g.drawText(tuning.notes[numStrings - 1 - str],
+        g.drawText(NoteUtils::getNoteName(tuning.getPitch(numStrings - 1 - str)),
                    5, y, stringNameWidth - 10, cellHeight,
                    juce::Justification::centredRight);
     }
@@ -58,7 +63,7 @@ void TabEditorComponent::drawGrid(juce::Graphics& g)
     }
 
     // Vertical lines (columns)
-    for (int col = 0; col <= numColumns; ++col)
+    for (int col = firstColumn; col <= lastColumn; ++col)
     {
         int x = stringNameWidth + col * cellWidth;
 
@@ -81,7 +86,7 @@ void TabEditorComponent::drawGrid(juce::Graphics& g)
     g.setColour(juce::Colours::white);
     g.setFont(16.0f);
 
-    for (int col = 0; col < numColumns; ++col)
+    for (int col = firstColumn; col < lastColumn; ++col)
     {
         for (int str = 0; str < numStrings; ++str)
         {
@@ -162,6 +167,22 @@ void TabEditorComponent::resized()
 
 bool TabEditorComponent::keyPressed(const juce::KeyPress& key)
 {
+    // Undo/redo
+    if (key == juce::KeyPress('z', juce::ModifierKeys::commandModifier, 0))
+    {
+        tabEngine.undo();
+        setCursorPosition(currentColumn, currentString);
+        return true;
+    }
+
+    if (key == juce::KeyPress('z', juce::ModifierKeys::commandModifier | juce::ModifierKeys::shiftModifier, 0) ||
+        key == juce::KeyPress('y', juce::ModifierKeys::commandModifier, 0))
+    {
+        tabEngine.redo();
+        setCursorPosition(currentColumn, currentString);
+        return true;
+    }
+
     // Number keys (0-9) for fret numbers
     if (key.getTextCharacter() >= '0' && key.getTextCharacter() <= '9')
     {
@@ -217,10 +238,13 @@ bool TabEditorComponent::keyPressed(const juce::KeyPress& key)
         if (currentColumns > 1 && currentColumn >= 0 && currentColumn < currentColumns)
         {
             tabEngine.deleteColumn(currentColumn);
-            // Keep cursor in valid position
+            // Keep cursor in valid position. The engine's notification
+            // repaints from the deleted column on, which may not reach it.
             if (currentColumn >= tabEngine.getNumColumns())
+            {
                 currentColumn = tabEngine.getNumColumns() - 1;
-            repaint();
+                repaintCursor();
+            }
         }
         return true;
     }
@@ -230,9 +254,10 @@ bool TabEditorComponent::keyPressed(const juce::KeyPress& key)
     {
         // Insert after current cursor position
         tabEngine.insertColumn(currentColumn + 1);
-        // Move cursor to the new column
+        // Move cursor to the new column. Its old cell is left of the inserted
+        // one, so the engine's notification doesn't repaint it.
+        repaintCursor();
         currentColumn++;
-        repaint();
         return true;
     }
 
@@ -242,8 +267,8 @@ bool TabEditorComponent::keyPressed(const juce::KeyPress& key)
         // Insert bar line after current cursor position
         tabEngine.insertBarLine(currentColumn + 1);
         // Move cursor to the new bar line column
+        repaintCursor();
         currentColumn++;
-        repaint();
         return true;
     }
 
@@ -260,10 +285,39 @@ void TabEditorComponent::mouseDown(const juce::MouseEvent& event)
     }
 }
 
-void TabEditorComponent::tabDataChanged()
+void TabEditorComponent::tabDataChanged(const TabChange& change)
 {
-    updateSize();
-    repaint();
+    // A different part or a new layout means the whole grid is stale
+    if (change.has(TabChange::structureChanged) || change.has(TabChange::selectionChanged))
+    {
+        updateSize();
+        repaint();
+        return;
+    }
+
+    if (change.has(TabChange::tuningChanged))
+        repaint(0, 0, stringNameWidth, getHeight());
+
+    if (!change.affectsPart(tabEngine.getCurrentSection(), tabEngine.getCurrentPart()))
+        return;
+
+    if (change.has(TabChange::columnsChanged))
+    {
+        // Everything from the first inserted or removed column onwards has moved
+        updateSize();
+        int x = stringNameWidth + change.columns.getStart() * cellWidth - 2;
+        repaint(x, 0, getWidth() - x, getHeight());
+    }
+    else if (change.has(TabChange::cellsEdited))
+    {
+        // Strings are drawn highest first, so the top-left cell is on the last string
+        juce::Rectangle<int> topLeft, bottomRight;
+        getCellBounds(change.columns.getStart(), change.strings.getEnd() - 1, topLeft);
+        getCellBounds(change.columns.getEnd() - 1, change.strings.getStart(), bottomRight);
+
+        // Expanded to take in the thick bar line drawn on the column's left edge
+        repaint(topLeft.getUnion(bottomRight).expanded(2));
+    }
 }
 
 void TabEditorComponent::updateSize()
@@ -283,9 +337,10 @@ void TabEditorComponent::moveCursor(int deltaColumn, int deltaString)
     pendingFretInput = "";
     pendingTechnique = Technique::None;
 
+    repaintCursor();
     currentColumn = juce::jlimit(0, tabEngine.getNumColumns() - 1, currentColumn + deltaColumn);
     currentString = juce::jlimit(0, tabEngine.getNumStrings() - 1, currentString + deltaString);
-    repaint();
+    repaintCursor();
 }
 
 void TabEditorComponent::setCursorPosition(int column, int string)
@@ -294,9 +349,10 @@ void TabEditorComponent::setCursorPosition(int column, int string)
     pendingFretInput = "";
     pendingTechnique = Technique::None;
 
+    repaintCursor();
     currentColumn = juce::jlimit(0, tabEngine.getNumColumns() - 1, column);
     currentString = juce::jlimit(0, tabEngine.getNumStrings() - 1, string);
-    repaint();
+    repaintCursor();
 }
 
 void TabEditorComponent::getCellBounds(int column, int string, juce::Rectangle<int>& bounds) const
@@ -310,6 +366,15 @@ void TabEditorComponent::getCellBounds(int column, int string, juce::Rectangle<i
     bounds.setHeight(cellHeight);
 }
 
+void TabEditorComponent::repaintCursor()
+{
+    // Edits repaint themselves through tabDataChanged; this is only for the
+    // cursor, which the engine doesn't know about
+    juce::Rectangle<int> bounds;
+    getCellBounds(currentColumn, currentString, bounds);
+    repaint(bounds);
+}
+
 bool TabEditorComponent::getCellAtPosition(int x, int y, int& column, int& string) const
 {
     if (x < stringNameWidth || y < 20)
@@ -366,9 +431,11 @@ void TabEditorComponent::enterDigit(int digit)
     // If it's a valid fret number (0-24), display it immediately
     if (fretValue >= 0 && fretValue <= 24)
     {
-        tabEngine.setFret(currentColumn, currentString, fretValue);
-        tabEngine.setTechnique(currentColumn, currentString, pendingTechnique, techniqueBeforeFret);
-        repaint();
+        {
+            TabEngine::ScopedTransaction transaction(tabEngine);
+            tabEngine.setFret(currentColumn, currentString, fretValue);
+            tabEngine.setTechnique(currentColumn, currentString, pendingTechnique, techniqueBeforeFret);
+        }
 
         // If we have 2 digits or the value is > 2 (can't go higher), clear pending input
         // but don't auto-advance
@@ -406,11 +473,13 @@ void TabEditorComponent::enterTechniqueChar(char c)
     // Special handling for mute - can be entered on empty cells
     if (tech == Technique::Mute)
     {
-        tabEngine.setFret(currentColumn, currentString, 0); // Use fret 0 as placeholder
-        tabEngine.setTechnique(currentColumn, currentString, tech);
+        {
+            TabEngine::ScopedTransaction transaction(tabEngine);
+            tabEngine.setFret(currentColumn, currentString, 0); // Use fret 0 as placeholder
+            tabEngine.setTechnique(currentColumn, currentString, tech);
+        }
         pendingFretInput = "";
         pendingTechnique = Technique::None;
-        repaint();
         return;
     }
 
@@ -422,7 +491,6 @@ void TabEditorComponent::enterTechniqueChar(char c)
     if (currentFret >= 0)
     {
         tabEngine.setTechnique(currentColumn, currentString, tech, false); // false = after fret
-        repaint();
     }
     // Otherwise, the technique will be applied BEFORE when the next digit is entered
 }
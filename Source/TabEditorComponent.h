@@ -19,7 +19,7 @@ public:
     void mouseDown(const juce::MouseEvent& event) override;
 
     // TabEngine::Listener
-    void tabDataChanged() override;
+    void tabDataChanged(const TabChange& change) override;
 
     // Navigation
     void moveCursor(int deltaColumn, int deltaString);
@@ -50,6 +50,7 @@ private:
     void drawGrid(juce::Graphics& g);
     void drawCursor(juce::Graphics& g);
     void getCellBounds(int column, int string, juce::Rectangle<int>& bounds) const;
+    void repaintCursor();
     bool getCellAtPosition(int x, int y, int& column, int& string) const;
 
     void enterFret(int fret);
@@ -1,885 +1,4227 @@
 #include "TabEngine.h"
-
-TabEngine::TabEngine()
-    : numStrings(6), rootNote("E"), tuningType(TuningType::Standard), currentSectionIndex(0), currentPartIndex(0)
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
+
+//==============================================================================
+// Hands out memory from the arena's slab. Copies of it live on in each chunk's
+// control block and keep the slab alive until the last chunk is released.
+template <typename T>
+struct TabColumnSequence::ChunkArena::Allocator
 {
-    // Initialize custom tuning with standard E
-    customTuning = GuitarTuning::createStandard("E", 6);
-
-    // Start with one default section
-    sections.push_back(TabSection("Intro", numStrings, 16));
-}
+    using value_type = T;
 
-TabEngine::~TabEngine()
-{
-}
+    ChunkArena* arena;
+    std::shared_ptr<char[]> slab;
 
-void TabEngine::setNumStrings(int num)
-{
-    if (num < 4 || num > 9)
-        return;
+    Allocator(ChunkArena& owner) : arena(&owner), slab(owner.slab) {}
 
-    numStrings = num;
+    template <typename U>
+    Allocator(const Allocator<U>& other) : arena(other.arena), slab(other.slab) {}
 
-    // Resize all columns in all parts in all sections
-    for (auto& section : sections)
+    T* allocate(size_t n)
     {
-        for (auto& part : section.parts)
-        {
-            for (auto& col : part.columns)
-                col = TabColumn(numStrings);
-        }
+        auto offset = (arena->used + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+        arena->used = offset + n * sizeof(T);
+        jassert(arena->used <= arena->capacity);
+        return reinterpret_cast<T*>(slab.get() + offset);
     }
 
-    // Update tuning for new string count
-    updateTuning();
+    // Memory goes back all at once when the slab is released
+    void deallocate(T*, size_t) noexcept {}
+
+    template <typename U>
+    bool operator==(const Allocator<U>& other) const { return slab == other.slab; }
 
-    notifyListeners();
+    template <typename U>
+    bool operator!=(const Allocator<U>& other) const { return slab != other.slab; }
+};
+
+// Room for one chunk plus its control block
+static constexpr size_t arenaBytesPerChunk = 1280;
+
+TabColumnSequence::ChunkArena::ChunkArena(size_t numChunks)
+    : capacity(juce::jmin(numChunks, maxChunks) * arenaBytesPerChunk)
+{
+    static_assert(sizeof(Chunk) + 64 <= arenaBytesPerChunk, "Arena slot too small for a chunk");
+
+    if (capacity > 0)
+        slab = std::shared_ptr<char[]>(new char[capacity]);
 }
 
-void TabEngine::setRootNote(const juce::String& note)
+size_t TabColumnSequence::ChunkArena::chunksNeeded(int numCols)
 {
-    rootNote = note;
-    updateTuning();
-    notifyListeners();
+    return (size_t)((juce::jmax(0, numCols) + chunkCapacity - 1) / chunkCapacity);
 }
 
-void TabEngine::setTuningType(TuningType type)
+std::shared_ptr<TabColumnSequence::Chunk> TabColumnSequence::ChunkArena::allocate()
 {
-    tuningType = type;
-    updateTuning();
-    notifyListeners();
+    if (used + arenaBytesPerChunk <= capacity)
+        return std::allocate_shared<Chunk>(Allocator<Chunk>(*this));
+
+    return std::make_shared<Chunk>();
 }
 
-void TabEngine::setCustomStringNote(int stringIndex, const juce::String& note)
+//==============================================================================
+TabColumnSequence::TabColumnSequence(int numStrings, int numCols)
 {
-    if (stringIndex >= 0 && stringIndex < (int)customTuning.notes.size())
-    {
-        customTuning.notes[stringIndex] = note;
-        notifyListeners();
-    }
+    rebuild(numStrings, numCols, nullptr);
 }
 
-juce::String TabEngine::getStringNote(int stringIndex) const
+TabColumnSequence::TabColumnSequence(int numStrings, int numCols, ChunkArena& arena)
 {
-    auto tuning = getCurrentTuning();
-    if (stringIndex >= 0 && stringIndex < (int)tuning.notes.size())
-        return tuning.notes[stringIndex];
-    return "";
+    rebuild(numStrings, numCols, &arena);
 }
 
-void TabEngine::updateTuning()
+int TabColumnSequence::findChunk(int index) const
 {
-    // Update custom tuning based on current settings
-    switch (tuningType)
-    {
-        case TuningType::Standard:
-            customTuning = GuitarTuning::createStandard(rootNote, numStrings);
-            break;
+    auto it = std::upper_bound(chunkStarts.begin(), chunkStarts.end(), index);
+    return (int)(it - chunkStarts.begin()) - 1;
+}
 
-        case TuningType::Drop:
-            customTuning = GuitarTuning::createDrop(rootNote, numStrings);
-            break;
+TabColumnSequence::Chunk& TabColumnSequence::editChunk(int chunkIndex)
+{
+    auto& chunk = chunks[(size_t)chunkIndex];
 
-        case TuningType::Open:
-            customTuning = GuitarTuning::createOpen(rootNote, numStrings);
-            break;
+    // Another sequence still shares this chunk, so take a private copy first
+    if (chunk.use_count() > 1)
+        chunk = std::make_shared<Chunk>(*chunk);
 
-        case TuningType::Custom:
-            // Resize if needed, but keep existing notes
-            while ((int)customTuning.notes.size() < numStrings)
-                customTuning.notes.push_back("E");
-            while ((int)customTuning.notes.size() > numStrings)
-                customTuning.notes.pop_back();
-            break;
-    }
+    return *chunk;
 }
 
-GuitarTuning TabEngine::getCurrentTuning() const
+TabColumn TabColumnSequence::getColumn(int index)
 {
-    return customTuning;
+    int c = findChunk(index);
+    return TabColumn(editChunk(c).cells + (index - chunkStarts[(size_t)c]) * stride, stride);
 }
 
-// Section management
-void TabEngine::addSection(const juce::String& name)
+ConstTabColumn TabColumnSequence::getColumn(int index) const
 {
-    sections.push_back(TabSection(name, numStrings, 16));
-    notifyListeners();
+    int c = findChunk(index);
+    return ConstTabColumn(chunks[(size_t)c]->cells + (index - chunkStarts[(size_t)c]) * stride, stride);
 }
 
-void TabEngine::removeSection(int sectionIndex)
+bool TabColumnSequence::isBarLine(int index) const
 {
-    if (sectionIndex >= 0 && sectionIndex < (int)sections.size() && sections.size() > 1)
-    {
-        sections.erase(sections.begin() + sectionIndex);
-
-        // Adjust current section index if needed
-        if (currentSectionIndex >= (int)sections.size())
-            currentSectionIndex = (int)sections.size() - 1;
-        if (currentSectionIndex < 0)
-            currentSectionIndex = 0;
-
-        notifyListeners();
-    }
+    int c = findChunk(index);
+    return ((chunks[(size_t)c]->barLines >> (index - chunkStarts[(size_t)c])) & 1) != 0;
 }
 
-void TabEngine::renameSection(int sectionIndex, const juce::String& newName)
+void TabColumnSequence::setBarLine(int index, bool barLine)
 {
-    if (sectionIndex >= 0 && sectionIndex < (int)sections.size())
-    {
-        sections[sectionIndex].name = newName;
-        notifyListeners();
-    }
+    int c = findChunk(index);
+    auto bit = (juce::uint64)1 << (index - chunkStarts[(size_t)c]);
+    auto& chunk = editChunk(c);
+
+    if (barLine)
+        chunk.barLines |= bit;
+    else
+        chunk.barLines &= ~bit;
 }
 
-juce::String TabEngine::getSectionName(int sectionIndex) const
+void TabColumnSequence::reset(int numStrings, int numCols)
 {
-    if (sectionIndex >= 0 && sectionIndex < (int)sections.size())
-        return sections[sectionIndex].name;
-    return "";
+    rebuild(numStrings, numCols, nullptr);
 }
 
-void TabEngine::setCurrentSection(int sectionIndex)
+void TabColumnSequence::rebuild(int numStrings, int numCols, ChunkArena* arena)
 {
-    if (sectionIndex >= 0 && sectionIndex < (int)sections.size())
+    stride = juce::jlimit(1, maxStrings, numStrings);
+    numColumns = juce::jmax(0, numCols);
+
+    chunks.clear();
+    chunkStarts.clear();
+    chunks.reserve(ChunkArena::chunksNeeded(numColumns));
+    chunkStarts.reserve(ChunkArena::chunksNeeded(numColumns));
+
+    for (int start = 0; start < numColumns; start += chunkCapacity)
     {
-        currentSectionIndex = sectionIndex;
-        currentPartIndex = 0; // Reset to first part when switching sections
-        notifyListeners();
+        auto chunk = arena != nullptr ? arena->allocate() : std::make_shared<Chunk>();
+        chunk->numColumns = juce::jmin(chunkCapacity, numColumns - start);
+        chunks.push_back(std::move(chunk));
+        chunkStarts.push_back(start);
     }
 }
 
-void TabEngine::clearSection(int sectionIndex)
+void TabColumnSequence::insert(int beforeIndex, bool barLine)
 {
-    if (sectionIndex >= 0 && sectionIndex < (int)sections.size())
+    if (chunks.empty())
     {
-        // Clear all parts in the section by recreating them with empty data
-        sections[sectionIndex].parts.clear();
-        sections[sectionIndex].parts.push_back(TabPart("Part 1", numStrings, 16));
+        chunks.push_back(std::make_shared<Chunk>());
+        chunkStarts.push_back(0);
+    }
 
-        // Reset current part index if this is the current section
-        if (sectionIndex == currentSectionIndex)
-            currentPartIndex = 0;
+    // Appending goes into the last chunk, everything else into the chunk holding beforeIndex
+    int c = beforeIndex >= numColumns ? (int)chunks.size() - 1 : findChunk(beforeIndex);
+    int local = beforeIndex - chunkStarts[(size_t)c];
+
+    if (chunks[(size_t)c]->numColumns == chunkCapacity)
+    {
+        splitChunk(c, chunkCapacity / 2);
 
-        notifyListeners();
+        if (local > chunks[(size_t)c]->numColumns)
+        {
+            local -= chunks[(size_t)c]->numColumns;
+            ++c;
+        }
     }
+
+    auto& chunk = editChunk(c);
+    TabCell* slot = chunk.cells + local * stride;
+    std::move_backward(slot, chunk.cells + chunk.numColumns * stride, chunk.cells + (chunk.numColumns + 1) * stride);
+    std::fill(slot, slot + stride, TabCell());
+
+    auto lowMask = ((juce::uint64)1 << local) - 1;
+    chunk.barLines = (chunk.barLines & lowMask)
+                   | ((chunk.barLines & ~lowMask) << 1)
+                   | (barLine ? (juce::uint64)1 << local : 0);
+
+    ++chunk.numColumns;
+    ++numColumns;
+
+    for (size_t i = (size_t)c + 1; i < chunkStarts.size(); ++i)
+        ++chunkStarts[i];
 }
 
-std::unique_ptr<juce::XmlElement> TabEngine::copySectionToXML(int sectionIndex) const
+void TabColumnSequence::remove(int index)
 {
-    if (sectionIndex < 0 || sectionIndex >= (int)sections.size())
-        return nullptr;
+    int c = findChunk(index);
+    int local = index - chunkStarts[(size_t)c];
 
-    auto xml = std::make_unique<juce::XmlElement>("SectionClipboard");
-    xml->setAttribute("name", sections[sectionIndex].name);
+    auto& chunk = editChunk(c);
+    std::move(chunk.cells + (local + 1) * stride, chunk.cells + chunk.numColumns * stride, chunk.cells + local * stride);
 
-    // Save all parts in this section
-    for (int p = 0; p < (int)sections[sectionIndex].parts.size(); ++p)
-    {
-        auto* partXml = xml->createNewChildElement("Part");
-        partXml->setAttribute("index", p);
-        partXml->setAttribute("name", sections[sectionIndex].parts[p].name);
-        partXml->setAttribute("numColumns", (int)sections[sectionIndex].parts[p].columns.size());
+    auto lowMask = ((juce::uint64)1 << local) - 1;
+    chunk.barLines = (chunk.barLines & lowMask) | ((chunk.barLines >> 1) & ~lowMask);
 
-        for (int col = 0; col < (int)sections[sectionIndex].parts[p].columns.size(); ++col)
-        {
-            auto* columnXml = partXml->createNewChildElement("Column");
-            columnXml->setAttribute("index", col);
+    --chunk.numColumns;
+    --numColumns;
 
-            for (int str = 0; str < numStrings; ++str)
-            {
-                int fret = sections[sectionIndex].parts[p].columns[col].getFret(str);
-                if (fret >= 0)
-                {
-                    auto* noteXml = columnXml->createNewChildElement("Note");
-                    noteXml->setAttribute("string", str);
-                    noteXml->setAttribute("fret", fret);
-                    noteXml->setAttribute("technique", (int)sections[sectionIndex].parts[p].columns[col].getTechnique(str));
-                }
-            }
-        }
-    }
+    for (size_t i = (size_t)c + 1; i < chunkStarts.size(); ++i)
+        --chunkStarts[i];
 
-    return xml;
+    if (chunk.numColumns == 0)
+    {
+        chunks.erase(chunks.begin() + c);
+        chunkStarts.erase(chunkStarts.begin() + c);
+    }
+    else if (chunk.numColumns < chunkCapacity / 4)
+    {
+        // Fold a nearly empty chunk into a neighbour so lookups stay short
+        if (c + 1 < (int)chunks.size() && chunk.numColumns + chunks[(size_t)c + 1]->numColumns <= chunkCapacity)
+            mergeWithNext(c);
+        else if (c > 0 && chunk.numColumns + chunks[(size_t)c - 1]->numColumns <= chunkCapacity)
+            mergeWithNext(c - 1);
+    }
 }
 
-void TabEngine::pasteSectionFromXML(int sectionIndex, const juce::XmlElement& xml)
+void TabColumnSequence::insertCopies(int beforeIndex, int sourceStart, int count)
 {
-    if (sectionIndex < 0 || sectionIndex >= (int)sections.size())
-        return;
+    jassert(sourceStart >= 0 && sourceStart + count <= numColumns && beforeIndex >= 0 && beforeIndex <= numColumns);
 
-    if (!xml.hasTagName("SectionClipboard"))
+    if (count <= 0)
         return;
 
-    // Clear existing parts in target section
-    sections[sectionIndex].parts.clear();
+    auto lowBits = [](int n) { return n >= 64 ? ~(juce::uint64)0 : ((juce::uint64)1 << n) - 1; };
 
-    // Load parts from clipboard
-    for (auto* partXml : xml.getChildIterator())
+    // Pack the copies into new chunks while the source is still in place
+    std::vector<std::shared_ptr<Chunk>> copies;
+    copies.reserve(ChunkArena::chunksNeeded(count));
+
+    for (int col = sourceStart, end = sourceStart + count, c = findChunk(sourceStart); col < end; ++c)
     {
-        if (partXml->hasTagName("Part"))
+        const auto& source = *chunks[(size_t)c];
+        int local = col - chunkStarts[(size_t)c];
+        int available = juce::jmin(source.numColumns - local, end - col);
+
+        while (available > 0)
         {
-            juce::String partName = partXml->getStringAttribute("name", "Part 1");
-            int numCols = partXml->getIntAttribute("numColumns", 16);
+            if (copies.empty() || copies.back()->numColumns == chunkCapacity)
+                copies.push_back(std::make_shared<Chunk>());
 
-            sections[sectionIndex].parts.push_back(TabPart(partName, numStrings, numCols));
-            int pIndex = (int)sections[sectionIndex].parts.size() - 1;
+            auto& dest = *copies.back();
+            int n = juce::jmin(available, chunkCapacity - dest.numColumns);
 
-            for (auto* columnXml : partXml->getChildIterator())
-            {
-                if (columnXml->hasTagName("Column"))
-                {
-                    int colIndex = columnXml->getIntAttribute("index");
+            std::copy(source.cells + local * stride, source.cells + (local + n) * stride, dest.cells + dest.numColumns * stride);
+            dest.barLines |= ((source.barLines >> local) & lowBits(n)) << dest.numColumns;
+            dest.numColumns += n;
 
-                    if (colIndex >= 0 && colIndex < numCols)
-                    {
-                        for (auto* noteXml : columnXml->getChildIterator())
-                        {
-                            if (noteXml->hasTagName("Note"))
-                            {
-                                int str = noteXml->getIntAttribute("string");
-                                int fret = noteXml->getIntAttribute("fret");
-                                int tech = noteXml->getIntAttribute("technique", (int)Technique::None);
-                                sections[sectionIndex].parts[pIndex].columns[colIndex].setFret(str, fret);
-                                sections[sectionIndex].parts[pIndex].columns[colIndex].setTechnique(str, (Technique)tech);
-                            }
-                        }
-                    }
-                }
-            }
+            local += n;
+            col += n;
+            available -= n;
         }
     }
 
-    // Ensure section has at least one part
-    if (sections[sectionIndex].parts.empty())
-        sections[sectionIndex].parts.push_back(TabPart("Part 1", numStrings, 16));
+    // Split the chunk holding beforeIndex so the copies go in on a boundary
+    auto at = chunks.size();
 
-    // Reset current part index if this is the current section
-    if (sectionIndex == currentSectionIndex)
+    if (beforeIndex < numColumns)
     {
-        if (currentPartIndex >= (int)sections[sectionIndex].parts.size())
-            currentPartIndex = 0;
+        int c = findChunk(beforeIndex);
+        int local = beforeIndex - chunkStarts[(size_t)c];
+
+        if (local > 0)
+            splitChunk(c++, local);
+
+        at = (size_t)c;
     }
 
-    notifyListeners();
+    chunks.insert(chunks.begin() + (std::ptrdiff_t)at, copies.begin(), copies.end());
+    chunkStarts.insert(chunkStarts.begin() + (std::ptrdiff_t)at, copies.size(), 0);
+    numColumns += count;
+
+    for (auto i = at; i < chunks.size(); ++i)
+        chunkStarts[i] = i == 0 ? 0 : chunkStarts[i - 1] + chunks[i - 1]->numColumns;
 }
 
-TabSection* TabEngine::getCurrentSectionPtr()
+void TabColumnSequence::splitChunk(int chunkIndex, int keep)
 {
-    if (currentSectionIndex >= 0 && currentSectionIndex < (int)sections.size())
-        return &sections[currentSectionIndex];
-    return nullptr;
+    auto& chunk = editChunk(chunkIndex);
+
+    auto tail = std::make_shared<Chunk>();
+    tail->numColumns = chunk.numColumns - keep;
+    tail->barLines = chunk.barLines >> keep;
+    std::copy(chunk.cells + keep * stride, chunk.cells + chunk.numColumns * stride, tail->cells);
+
+    std::fill(chunk.cells + keep * stride, chunk.cells + chunk.numColumns * stride, TabCell());
+    chunk.barLines &= ((juce::uint64)1 << keep) - 1;
+    chunk.numColumns = keep;
+
+    chunks.insert(chunks.begin() + chunkIndex + 1, std::move(tail));
+    chunkStarts.insert(chunkStarts.begin() + chunkIndex + 1, chunkStarts[(size_t)chunkIndex] + keep);
 }
 
-const TabSection* TabEngine::getCurrentSectionPtr() const
+void TabColumnSequence::mergeWithNext(int chunkIndex)
 {
-    if (currentSectionIndex >= 0 && currentSectionIndex < (int)sections.size())
-        return &sections[currentSectionIndex];
-    return nullptr;
+    auto& chunk = editChunk(chunkIndex);
+    const auto& next = *chunks[(size_t)chunkIndex + 1];
+
+    std::copy(next.cells, next.cells + next.numColumns * stride, chunk.cells + chunk.numColumns * stride);
+    chunk.barLines |= next.barLines << chunk.numColumns;
+    chunk.numColumns += next.numColumns;
+
+    chunks.erase(chunks.begin() + chunkIndex + 1);
+    chunkStarts.erase(chunkStarts.begin() + chunkIndex + 1);
 }
 
-TabPart* TabEngine::getCurrentPartPtr()
+void TabColumnSequence::append(const TabColumnSequence& other)
 {
-    auto* section = getCurrentSectionPtr();
-    if (!section) return nullptr;
+    jassert(other.stride == stride);
 
-    if (currentPartIndex >= 0 && currentPartIndex < (int)section->parts.size())
-        return &section->parts[currentPartIndex];
-    return nullptr;
+    for (size_t i = 0; i < other.chunks.size(); ++i)
+    {
+        chunks.push_back(other.chunks[i]);
+        chunkStarts.push_back(numColumns + other.chunkStarts[i]);
+    }
+
+    numColumns += other.numColumns;
 }
 
-const TabPart* TabEngine::getCurrentPartPtr() const
+//==============================================================================
+bool TabChange::affectsPart(int section, int part) const
 {
-    auto* section = getCurrentSectionPtr();
-    if (!section) return nullptr;
+    return (sectionIndex < 0 || sectionIndex == section) && (partIndex < 0 || partIndex == part);
+}
 
-    if (currentPartIndex >= 0 && currentPartIndex < (int)section->parts.size())
-        return &section->parts[currentPartIndex];
-    return nullptr;
+TabChange TabChange::cells(int section, int part, juce::Range<int> columnRange, juce::Range<int> stringRange)
+{
+    TabChange change;
+    change.kinds = cellsEdited;
+    change.sectionIndex = section;
+    change.partIndex = part;
+    change.columns = columnRange;
+    change.strings = stringRange;
+    return change;
 }
 
-// Part management
-int TabEngine::getNumParts() const
+TabChange TabChange::columnsFrom(int section, int part, int firstColumn)
 {
-    auto* section = getCurrentSectionPtr();
-    if (section)
-        return (int)section->parts.size();
-    return 0;
+    TabChange change;
+    change.kinds = columnsChanged;
+    change.sectionIndex = section;
+    change.partIndex = part;
+    change.columns = { firstColumn, std::numeric_limits<int>::max() };
+    change.strings = { 0, TabColumnSequence::maxStrings };
+    return change;
 }
 
-void TabEngine::addPart(const juce::String& name)
+TabChange TabChange::of(int kindFlags)
 {
-    auto* section = getCurrentSectionPtr();
-    if (!section) return;
+    TabChange change;
+    change.kinds = kindFlags;
+    return change;
+}
 
-    section->parts.push_back(TabPart(name, numStrings, 16));
-    notifyListeners();
+TabChange TabChange::everything()
+{
+    auto change = of(cellsEdited | columnsChanged | structureChanged | tuningChanged | selectionChanged);
+    change.columns = { 0, std::numeric_limits<int>::max() };
+    change.strings = { 0, TabColumnSequence::maxStrings };
+    return change;
 }
 
-void TabEngine::removePart(int partIndex)
+void TabChange::merge(const TabChange& other)
 {
-    auto* section = getCurrentSectionPtr();
-    if (!section) return;
+    const int partScoped = cellsEdited | columnsChanged;
 
-    if (partIndex >= 0 && partIndex < (int)section->parts.size() && section->parts.size() > 1)
+    if ((other.kinds & partScoped) != 0)
     {
-        section->parts.erase(section->parts.begin() + partIndex);
-
-        // Adjust current part index if needed
-        if (currentPartIndex >= (int)section->parts.size())
-            currentPartIndex = (int)section->parts.size() - 1;
-        if (currentPartIndex < 0)
-            currentPartIndex = 0;
+        if ((kinds & partScoped) == 0)
+        {
+            sectionIndex = other.sectionIndex;
+            partIndex = other.partIndex;
+            columns = other.columns;
+            strings = other.strings;
+        }
+        else
+        {
+            // Edits to different parts widen the change to cover any part
+            if (sectionIndex != other.sectionIndex || partIndex != other.partIndex)
+                sectionIndex = partIndex = -1;
 
-        notifyListeners();
+            columns = columns.getUnionWith(other.columns);
+            strings = strings.getUnionWith(other.strings);
+        }
     }
+
+    kinds |= other.kinds;
 }
 
-void TabEngine::renamePart(int partIndex, const juce::String& newName)
-{
-    auto* section = getCurrentSectionPtr();
-    if (!section) return;
+//==============================================================================
+static_assert(sizeof(TabJournal::Record) == 16, "Journal records should stay compact");
 
-    if (partIndex >= 0 && partIndex < (int)section->parts.size())
-    {
-        section->parts[partIndex].name = newName;
-        notifyListeners();
-    }
+static size_t getNodeBytes(const TabPart& part)
+{
+    return sizeof(TabPart) + part.columns.getStorageBytes();
 }
 
-juce::String TabEngine::getPartName(int partIndex) const
+static size_t getNodeBytes(const TabSection& section)
 {
-    auto* section = getCurrentSectionPtr();
-    if (!section) return "";
-
-    if (partIndex >= 0 && partIndex < (int)section->parts.size())
-        return section->parts[partIndex].name;
-    return "";
+    size_t bytes = sizeof(TabSection) + section.unreadable.size;
+    for (const auto& part : section.parts)
+        bytes += getNodeBytes(*part);
+    return bytes;
 }
 
-void TabEngine::setCurrentPart(int partIndex)
+static size_t getNodeBytes(const TabDocument& doc)
 {
-    auto* section = getCurrentSectionPtr();
-    if (!section) return;
-
-    if (partIndex >= 0 && partIndex < (int)section->parts.size())
-    {
-        currentPartIndex = partIndex;
-        notifyListeners();
-    }
+    size_t bytes = sizeof(TabDocument);
+    for (const auto& section : doc.sections)
+        bytes += getNodeBytes(*section);
+    return bytes;
 }
 
-void TabEngine::clearPart(int partIndex)
+bool TabJournal::hasNode(Op op)
 {
-    auto* section = getCurrentSectionPtr();
-    if (!section) return;
-
-    if (partIndex >= 0 && partIndex < (int)section->parts.size())
+    switch (op)
     {
-        auto& part = section->parts[partIndex];
-        part.columns.clear();
-        part.columns.reserve(16);
-        for (int i = 0; i < 16; ++i)
-            part.columns.push_back(TabColumn(numStrings));
-        notifyListeners();
+        case Op::swapSection:
+        case Op::removeSection:
+        case Op::swapPart:
+        case Op::removePart:
+        case Op::swapDocument:
+            return true;
+
+        default:
+            return false;
     }
 }
 
-std::unique_ptr<juce::XmlElement> TabEngine::copyPartToXML(int partIndex) const
+size_t TabJournal::getRecordBytes(const Record& record, const std::shared_ptr<void>& node)
 {
-    auto* section = getCurrentSectionPtr();
-    if (!section) return nullptr;
-
-    if (partIndex >= 0 && partIndex < (int)section->parts.size())
+    // Nodes are counted in full even though they usually share most of their
+    // storage with the live document, so the limit errs on the safe side
+    switch (record.op)
     {
-        auto xml = std::make_unique<juce::XmlElement>("Part");
-        const auto& part = section->parts[partIndex];
-
-        xml->setAttribute("name", part.name);
-        xml->setAttribute("numColumns", (int)part.columns.size());
+        case Op::swapSection:
+        case Op::removeSection:
+            return sizeof(Record) + getNodeBytes(*static_cast<const TabSection*>(node.get()));
 
-        for (int col = 0; col < (int)part.columns.size(); ++col)
-        {
-            auto* colXml = xml->createNewChildElement("Column");
-            colXml->setAttribute("index", col);
+        case Op::swapPart:
+        case Op::removePart:
+            return sizeof(Record) + getNodeBytes(*static_cast<const TabPart*>(node.get()));
 
-            for (int str = 0; str < (int)part.columns[col].notes.size(); ++str)
-            {
-                const auto& note = part.columns[col].notes[str];
-                if (note.fret >= 0)
-                {
-                    auto* noteXml = colXml->createNewChildElement("Note");
-                    noteXml->setAttribute("string", str);
-                    noteXml->setAttribute("fret", note.fret);
-                    noteXml->setAttribute("technique", (int)note.technique);
-                }
-            }
-        }
+        case Op::swapDocument:
+            return sizeof(Record) + getNodeBytes(*static_cast<const TabDocument*>(node.get()));
 
-        return xml;
+        default:
+            return sizeof(Record);
     }
-
-    return nullptr;
 }
 
-void TabEngine::pastePartFromXML(int partIndex, const juce::XmlElement& xml)
+void TabJournal::Stack::push(const Record& record, std::shared_ptr<void> node)
 {
-    auto* section = getCurrentSectionPtr();
-    if (!section) return;
+    jassert(!steps.empty());
+    jassert(hasNode(record.op) == (node != nullptr));
 
-    if (partIndex >= 0 && partIndex < (int)section->parts.size())
-    {
-        auto& part = section->parts[partIndex];
-
-        // Load part name and columns
-        part.name = xml.getStringAttribute("name", "Pasted Part");
-        int numCols = xml.getIntAttribute("numColumns", 16);
-
-        // Clear and resize columns
-        part.columns.clear();
-        part.columns.reserve(numCols);
-        for (int i = 0; i < numCols; ++i)
-            part.columns.push_back(TabColumn(numStrings));
-
-        // Load notes
-        for (auto* colXml : xml.getChildWithTagNameIterator("Column"))
-        {
-            int colIndex = colXml->getIntAttribute("index", -1);
-            if (colIndex >= 0 && colIndex < (int)part.columns.size())
-            {
-                for (auto* noteXml : colXml->getChildWithTagNameIterator("Note"))
-                {
-                    int str = noteXml->getIntAttribute("string", -1);
-                    int fret = noteXml->getIntAttribute("fret", -1);
-                    int tech = noteXml->getIntAttribute("technique", 0);
+    auto recordBytes = getRecordBytes(record, node);
+    auto& step = steps.back();
 
-                    if (str >= 0 && str < (int)part.columns[colIndex].notes.size())
-                    {
-                        part.columns[colIndex].notes[str].fret = fret;
-                        part.columns[colIndex].notes[str].technique = (Technique)tech;
-                    }
-                }
-            }
-        }
+    records.push_back(record);
+    ++step.numRecords;
 
-        notifyListeners();
+    if (node != nullptr)
+    {
+        nodes.push_back(std::move(node));
+        ++step.numNodes;
     }
+
+    step.bytes += recordBytes;
+    bytes += recordBytes;
 }
 
-void TabEngine::setNumColumns(int num)
+void TabJournal::Stack::dropOldestStep()
 {
-    auto* part = getCurrentPartPtr();
-    if (!part) return;
+    const auto& step = steps.front();
 
-    part->columns.clear();
-    part->columns.reserve(num);
-    for (int i = 0; i < num; ++i)
-        part->columns.push_back(TabColumn(numStrings));
+    records.erase(records.begin(), records.begin() + (std::ptrdiff_t)step.numRecords);
+    nodes.erase(nodes.begin(), nodes.begin() + (std::ptrdiff_t)step.numNodes);
+    bytes -= step.bytes;
 
-    notifyListeners();
+    steps.pop_front();
 }
 
-int TabEngine::getNumColumns() const
+void TabJournal::Stack::clear()
 {
-    auto* part = getCurrentPartPtr();
-    if (part)
-        return (int)part->columns.size();
-    return 0;
+    records.clear();
+    nodes.clear();
+    steps.clear();
+    bytes = 0;
 }
 
-void TabEngine::setFret(int columnIndex, int stringIndex, int fret)
+void TabJournal::add(const Record& record, std::shared_ptr<void> node)
 {
-    auto* part = getCurrentPartPtr();
-    if (!part) return;
-
-    if (columnIndex >= 0 && columnIndex < (int)part->columns.size())
+    if (!stepOpen)
     {
-        part->columns[columnIndex].setFret(stringIndex, fret);
-        notifyListeners();
+        // A new edit makes everything that was undone unreachable
+        redoStack.clear();
+        undoStack.steps.emplace_back();
+        stepOpen = true;
     }
-}
-
-int TabEngine::getFret(int columnIndex, int stringIndex) const
-{
-    auto* part = getCurrentPartPtr();
-    if (!part) return -1;
 
-    if (columnIndex >= 0 && columnIndex < (int)part->columns.size())
-        return part->columns[columnIndex].getFret(stringIndex);
-    return -1;
+    undoStack.push(record, std::move(node));
 }
 
-void TabEngine::setTechnique(int columnIndex, int stringIndex, Technique tech, bool beforeFret)
+void TabJournal::closeStep()
 {
-    auto* part = getCurrentPartPtr();
-    if (!part) return;
-
-    if (columnIndex >= 0 && columnIndex < (int)part->columns.size())
+    if (stepOpen)
     {
-        part->columns[columnIndex].setTechnique(stringIndex, tech, beforeFret);
-        notifyListeners();
+        stepOpen = false;
+        trimToLimit();
     }
 }
 
-Technique TabEngine::getTechnique(int columnIndex, int stringIndex) const
+void TabJournal::trimToLimit()
 {
-    auto* part = getCurrentPartPtr();
-    if (!part) return Technique::None;
+    // Each direction has its own budget, so a long or heavy redo history
+    // can't squeeze undo out (or the other way round). Both keep their
+    // nearest step whatever it costs.
+    for (auto* stack : { &undoStack, &redoStack })
+        while (stack->steps.size() > 1 && stack->bytes > memoryLimit)
+            stack->dropOldestStep();
+}
 
-    if (columnIndex >= 0 && columnIndex < (int)part->columns.size())
-        return part->columns[columnIndex].getTechnique(stringIndex);
-    return Technique::None;
+void TabJournal::clear()
+{
+    undoStack.clear();
+    redoStack.clear();
+    stepOpen = false;
 }
 
-bool TabEngine::isTechniqueBeforeFret(int columnIndex, int stringIndex) const
+//==============================================================================
+TabEngine::TabEngine()
+    : document(std::make_shared<TabDocument>())
 {
-    auto* part = getCurrentPartPtr();
-    if (!part) return false;
+    // Start with one default section
+    document->sections.push_back(std::make_shared<TabSection>("Intro", document->numStrings, 16));
+}
 
-    if (columnIndex >= 0 && columnIndex < (int)part->columns.size())
-        return part->columns[columnIndex].isTechniqueBeforeFret(stringIndex);
-    return false;
+TabEngine::~TabEngine()
+{
+    cancelPendingUpdate();
 }
 
-void TabEngine::insertColumn(int beforeIndex)
+TabEngine::Snapshot TabEngine::getSnapshot() const
 {
-    auto* part = getCurrentPartPtr();
-    if (!part) return;
+    const juce::SpinLock::ScopedLockType lock(documentLock);
+    return document;
+}
 
-    if (beforeIndex >= 0 && beforeIndex <= (int)part->columns.size())
+std::shared_ptr<TabDocument> TabEngine::commitDocument(std::shared_ptr<TabDocument> newDocument)
+{
     {
-        part->columns.insert(part->columns.begin() + beforeIndex, TabColumn(numStrings));
-        notifyListeners();
+        const juce::SpinLock::ScopedLockType lock(documentLock);
+        document.swap(newDocument);
     }
+
+    // newDocument now holds the previous document
+    return newDocument;
 }
 
-void TabEngine::insertBarLine(int beforeIndex)
+void TabEngine::validateSelection(TabDocument& doc)
 {
-    auto* part = getCurrentPartPtr();
-    if (!part) return;
+    doc.currentSectionIndex = juce::jlimit(0, doc.getNumSections() - 1, doc.currentSectionIndex);
 
-    if (beforeIndex >= 0 && beforeIndex <= (int)part->columns.size())
-    {
-        part->columns.insert(part->columns.begin() + beforeIndex, TabColumn(numStrings, true));
-        notifyListeners();
-    }
+    // Undo can bring back a section that was never decoded as the current one
+    auto& current = doc.sections[(size_t)doc.currentSectionIndex];
+    current = decoded(current, doc.numStrings);
+
+    doc.currentPartIndex = juce::jlimit(0, doc.getSection(doc.currentSectionIndex).getNumParts() - 1, doc.currentPartIndex);
 }
 
-void TabEngine::deleteColumn(int index)
+TabDocument& TabEngine::editDocument()
 {
-    auto* part = getCurrentPartPtr();
-    if (!part) return;
+    // A snapshot still refers to the document, so edit a copy of it instead
+    if (document.use_count() > 1)
+        document = std::make_shared<TabDocument>(*document);
 
-    if (index >= 0 && index < (int)part->columns.size() && part->columns.size() > 1)
-    {
-        part->columns.erase(part->columns.begin() + index);
-        notifyListeners();
-    }
+    return *document;
 }
 
-void TabEngine::clearColumn(int index)
+TabSection& TabEngine::editSection(int sectionIndex)
 {
-    auto* part = getCurrentPartPtr();
-    if (!part) return;
+    auto& section = editDocument().sections[(size_t)sectionIndex];
 
-    if (index >= 0 && index < (int)part->columns.size())
-    {
-        part->columns[index] = TabColumn(numStrings);
-        notifyListeners();
+    if (section.use_count() > 1)
+        section = std::make_shared<TabSection>(*section);
+
+    return *section;
+}
+
+TabPart& TabEngine::editPart(int sectionIndex, int partIndex)
+{
+    auto& part = editSection(sectionIndex).parts[(size_t)partIndex];
+
+    if (part.use_count() > 1)
+        part = std::make_shared<TabPart>(*part);
+
+    return *part;
+}
+
+TabPart* TabEngine::editCurrentPart()
+{
+    if (getCurrentPartPtr() == nullptr)
+        return nullptr;
+
+    return &editPart(document->currentSectionIndex, document->currentPartIndex);
+}
+
+int TabEngine::setNumStrings(int num)
+{
+    if (num < 4 || num > 9)
+        return 0;
+
+    auto edited = std::make_shared<TabDocument>(*document);
+    edited->numStrings = num;
+
+    // Update tuning for new string count
+    updateTuning(*edited);
+
+    return commitRetuned(std::move(edited));
+}
+
+int TabEngine::setRootNote(const juce::String& note)
+{
+    int pitchClass = NoteUtils::getNoteIndex(note);
+    if (pitchClass < 0)
+        return 0;
+
+    auto edited = std::make_shared<TabDocument>(*document);
+    edited->rootNote = pitchClass;
+    updateTuning(*edited);
+
+    return commitRetuned(std::move(edited));
+}
+
+int TabEngine::setTuningType(TuningType type)
+{
+    auto edited = std::make_shared<TabDocument>(*document);
+    edited->tuningType = type;
+    updateTuning(*edited);
+
+    return commitRetuned(std::move(edited));
+}
+
+int TabEngine::setCustomStringNote(int stringIndex, const juce::String& note)
+{
+    int pitchClass = NoteUtils::getNoteIndex(note);
+
+    if (pitchClass >= 0 && stringIndex >= 0 && stringIndex < document->tuning.getNumStrings())
+    {
+        auto edited = std::make_shared<TabDocument>(*document);
+        auto& tuning = edited->tuning;
+
+        // Keep the string in the octave it was already in
+        tuning.setPitch(stringIndex, NoteUtils::getNearestPitch(pitchClass, tuning.getPitch(stringIndex)));
+
+        return commitRetuned(std::move(edited));
+    }
+
+    return 0;
+}
+
+int TabEngine::commitRetuned(std::shared_ptr<TabDocument> edited)
+{
+    const auto& current = *document;
+
+    // Picking the root or preset that's already in use changes nothing, and
+    // shouldn't leave an undo step behind
+    if (edited->numStrings == current.numStrings && edited->tuning == current.tuning
+        && edited->rootNote == current.rootNote && edited->tuningType == current.tuningType)
+        return 0;
+
+    // A new string count or tuning moves the notes, so the document changes
+    // as a whole; otherwise only the tuning settings differ
+    bool notesMoved = edited->numStrings != current.numStrings || !(edited->tuning == current.tuning);
+    int numDropped = notesMoved ? retune(current, *edited) : 0;
+
+    // The old document moves into the journal as it is
+    journal.add(makeRecord(TabJournal::Op::swapDocument, 0), commitDocument(std::move(edited)));
+    notifyListeners(notesMoved ? TabChange::everything() : TabChange::of(TabChange::tuningChanged));
+
+    return numDropped;
+}
+
+juce::String TabEngine::getStringNote(int stringIndex) const
+{
+    const auto& tuning = document->tuning;
+
+    if (stringIndex >= 0 && stringIndex < tuning.getNumStrings())
+        return NoteUtils::getNoteName(tuning.getPitch(stringIndex));
+    return "";
+}
+
+int TabEngine::applyNamedTuning(int index)
+{
+    if (index < 0 || index >= TuningTables::numNamed)
+        return 0;
+
+    const auto& preset = TuningTables::named[index].tuning;
+
+    auto edited = std::make_shared<TabDocument>(*document);
+    edited->numStrings = preset.getNumStrings();
+    edited->tuningType = TuningType::Custom;
+    edited->rootNote = preset.getPitchClass(0);
+    edited->tuning = preset;
+
+    return commitRetuned(std::move(edited));
+}
+
+void TabEngine::updateTuning(TabDocument& doc)
+{
+    // Update custom tuning based on current settings
+    switch (doc.tuningType)
+    {
+        case TuningType::Standard:
+            doc.tuning = GuitarTuning::createStandard(doc.rootNote, doc.numStrings);
+            break;
+
+        case TuningType::Drop:
+            doc.tuning = GuitarTuning::createDrop(doc.rootNote, doc.numStrings);
+            break;
+
+        case TuningType::Open:
+            doc.tuning = GuitarTuning::createOpen(doc.rootNote, doc.numStrings);
+            break;
+
+        case TuningType::Custom:
+            // Resize if needed, but keep existing notes
+            doc.tuning.resize(doc.numStrings);
+            break;
+    }
+}
+
+//==============================================================================
+// Where each note goes when the strings change. For every old string and fret
+// it lists the new string/fret pairs that sound the same pitch, nearest string
+// first, followed by the same note an octave or two away for pitches the new
+// tuning can't reach. Built once per retune, so moving a note is a lookup.
+struct RetuneMap
+{
+    static constexpr int maxStrings = GuitarTuning::maxStrings;
+    static constexpr int maxCandidates = 12;
+    static constexpr int numFrets = 128;
+
+    struct Candidate
+    {
+        juce::int8 stringIndex;
+        juce::int8 fret;
+    };
+
+    struct CandidateList
+    {
+        int size = 0;
+        Candidate items[maxCandidates];
+
+        void add(int stringIndex, int fret)
+        {
+            if (size < maxCandidates)
+                items[size++] = { (juce::int8)stringIndex, (juce::int8)fret };
+        }
+    };
+
+    CandidateList notes[maxStrings][numFrets];
+    CandidateList mutes[maxStrings]; // Mutes have no pitch, so only the string moves
+
+    RetuneMap(const GuitarTuning& from, const GuitarTuning& to)
+    {
+        static constexpr int octaveShifts[] = { -12, 12, -24, 24 };
+
+        for (int s = 0; s < from.getNumStrings(); ++s)
+        {
+            // New strings ordered by how close their open pitch is to this one
+            int order[maxStrings];
+            int numTo = to.getNumStrings();
+            for (int t = 0; t < numTo; ++t)
+                order[t] = t;
+
+            std::stable_sort(order, order + numTo, [&](int a, int b)
+            {
+                return std::abs(to.getPitch(a) - from.getPitch(s)) < std::abs(to.getPitch(b) - from.getPitch(s));
+            });
+
+            for (int i = 0; i < numTo; ++i)
+                mutes[s].add(order[i], 0);
+
+            for (int f = 0; f < numFrets; ++f)
+            {
+                auto& list = notes[s][f];
+                int pitch = from.getPitch(s) + f;
+                int highestFret = juce::jmax(TabCell::maxFret, f);
+
+                for (int i = 0; i < numTo; ++i)
+                {
+                    int fret = pitch - to.getPitch(order[i]);
+                    if (fret >= 0 && fret <= highestFret)
+                        list.add(order[i], fret);
+                }
+
+                for (int shift : octaveShifts)
+                {
+                    for (int i = 0; i < numTo; ++i)
+                    {
+                        int fret = pitch + shift - to.getPitch(order[i]);
+                        if (fret >= 0 && fret <= TabCell::maxFret)
+                            list.add(order[i], fret);
+                    }
+                }
+            }
+        }
+    }
+
+    // Places each note of one column on the first free string it can go to.
+    // Notes that find every candidate string taken are dropped; returns how
+    // many were.
+    int remap(ConstTabColumn from, TabColumn to) const
+    {
+        int used = 0;
+        int numDropped = 0;
+
+        for (int s = 0; s < from.getNumStrings(); ++s)
+        {
+            const auto& cell = from[s];
+            if (cell.isEmpty())
+                continue;
+
+            bool isMute = cell.getTechnique() == Technique::Mute;
+            const auto& list = isMute ? mutes[s] : notes[s][cell.fret];
+            bool placed = false;
+
+            for (int i = 0; i < list.size && !placed; ++i)
+            {
+                const auto& candidate = list.items[i];
+                int bit = 1 << candidate.stringIndex;
+
+                if ((used & bit) == 0)
+                {
+                    used |= bit;
+                    auto& moved = to[candidate.stringIndex];
+                    moved = cell;
+
+                    if (!isMute)
+                        moved.fret = candidate.fret;
+
+                    placed = true;
+                }
+            }
+
+            if (!placed)
+                ++numDropped;
+        }
+
+        return numDropped;
+    }
+};
+
+// Column chunks a section takes once decoded
+static size_t countChunks(const TabSection& section)
+{
+    if (!section.isDecoded())
+        return section.encoded.numChunks;
+
+    size_t numChunks = 0;
+    for (const auto& part : section.parts)
+        numChunks += TabColumnSequence::ChunkArena::chunksNeeded(part->getNumColumns());
+
+    return numChunks;
+}
+
+int TabEngine::retune(const TabDocument& from, TabDocument& to)
+{
+    auto map = std::make_unique<RetuneMap>(from.tuning, to.tuning);
+
+    // Every part gets new chunks, so take them all from one arena
+    size_t numChunks = 0;
+    for (const auto& section : from.sections)
+        numChunks += countChunks(*section);
+
+    TabColumnSequence::ChunkArena arena(numChunks);
+
+    // A part shared by several sections stays shared once retuned
+    std::map<const TabPart*, std::shared_ptr<TabPart>> retunedParts;
+    int numDropped = 0;
+
+    // The sections may still be shared, so each one is replaced rather than edited
+    for (auto& section : to.sections)
+    {
+        auto retuned = std::make_shared<TabSection>(*decoded(section, from.numStrings));
+
+        for (auto& part : retuned->parts)
+        {
+            auto& retunedPart = retunedParts[part.get()];
+
+            if (retunedPart == nullptr)
+            {
+                retunedPart = std::make_shared<TabPart>(part->name, part->columns.withNumStrings(to.numStrings, arena,
+                    [&](ConstTabColumn oldColumn, TabColumn newColumn) { numDropped += map->remap(oldColumn, newColumn); }));
+            }
+
+            part = retunedPart;
+        }
+
+        section = std::move(retuned);
+    }
+
+    return numDropped;
+}
+
+// Section management
+void TabEngine::addSection(const juce::String& name)
+{
+    auto section = std::make_shared<TabSection>(name, document->numStrings, 16);
+
+    {
+        const juce::SpinLock::ScopedLockType lock(documentLock);
+        editDocument().sections.push_back(std::move(section));
+    }
+
+    journal.add(makeRecord(TabJournal::Op::insertSection, getNumSections() - 1));
+
+    notifyListeners(TabChange::of(TabChange::structureChanged));
+}
+
+void TabEngine::removeSection(int sectionIndex)
+{
+    if (sectionIndex >= 0 && sectionIndex < getNumSections() && getNumSections() > 1)
+    {
+        std::shared_ptr<TabSection> removed;
+
+        {
+            const juce::SpinLock::ScopedLockType lock(documentLock);
+            auto& doc = editDocument();
+            removed = std::move(doc.sections[(size_t)sectionIndex]);
+            doc.sections.erase(doc.sections.begin() + sectionIndex);
+
+            // Adjust current section index if needed
+            if (doc.currentSectionIndex >= doc.getNumSections())
+                doc.currentSectionIndex = doc.getNumSections() - 1;
+            if (doc.currentSectionIndex < 0)
+                doc.currentSectionIndex = 0;
+        }
+
+        decodeCurrentSection();
+        journal.add(makeRecord(TabJournal::Op::removeSection, sectionIndex), std::move(removed));
+        notifyListeners(TabChange::of(TabChange::structureChanged | TabChange::selectionChanged));
+    }
+}
+
+void TabEngine::renameSection(int sectionIndex, const juce::String& newName)
+{
+    if (sectionIndex >= 0 && sectionIndex < getNumSections())
+    {
+        // Rename a copy so the old node can go into the journal. The copy is
+        // decoded, as an encoded one would still carry the old name.
+        auto renamed = std::make_shared<TabSection>(*decoded(document->sections[(size_t)sectionIndex], document->numStrings));
+        renamed->name = newName;
+
+        {
+            const juce::SpinLock::ScopedLockType lock(documentLock);
+            editDocument().sections[(size_t)sectionIndex].swap(renamed);
+        }
+
+        journal.add(makeRecord(TabJournal::Op::swapSection, sectionIndex), std::move(renamed));
+
+        notifyListeners(TabChange::of(TabChange::structureChanged));
+    }
+}
+
+juce::String TabEngine::getSectionName(int sectionIndex) const
+{
+    if (sectionIndex >= 0 && sectionIndex < getNumSections())
+        return document->getSection(sectionIndex).name;
+    return "";
+}
+
+void TabEngine::setCurrentSection(int sectionIndex)
+{
+    if (sectionIndex >= 0 && sectionIndex < getNumSections())
+    {
+        {
+            const juce::SpinLock::ScopedLockType lock(documentLock);
+            auto& doc = editDocument();
+            doc.currentSectionIndex = sectionIndex;
+            doc.currentPartIndex = 0; // Reset to first part when switching sections
+        }
+
+        decodeCurrentSection();
+        notifyListeners(TabChange::of(TabChange::selectionChanged));
+    }
+}
+
+void TabEngine::clearSection(int sectionIndex)
+{
+    if (sectionIndex >= 0 && sectionIndex < getNumSections())
+    {
+        // Clear all parts in the section by replacing it with one holding a single empty part
+        auto cleared = std::make_shared<TabSection>(document->getSection(sectionIndex).name, document->numStrings, 16);
+
+        {
+            const juce::SpinLock::ScopedLockType lock(documentLock);
+            auto& doc = editDocument();
+            doc.sections[(size_t)sectionIndex].swap(cleared);
+
+            // Reset current part index if this is the current section
+            if (sectionIndex == doc.currentSectionIndex)
+                doc.currentPartIndex = 0;
+        }
+
+        // The cleared section moves into the journal rather than being copied
+        journal.add(makeRecord(TabJournal::Op::swapSection, sectionIndex), std::move(cleared));
+
+        notifyListeners(TabChange::of(TabChange::structureChanged | TabChange::selectionChanged));
+    }
+}
+
+std::shared_ptr<const TabSection> TabEngine::copySection(int sectionIndex) const
+{
+    if (sectionIndex < 0 || sectionIndex >= getNumSections())
+        return nullptr;
+
+    return decoded(document->sections[(size_t)sectionIndex], document->numStrings);
+}
+
+void TabEngine::pasteSection(int sectionIndex, const TabSection& clip)
+{
+    if (sectionIndex < 0 || sectionIndex >= getNumSections() || !clip.isDecoded())
+        return;
+
+    // The new section shares the clipboard's parts
+    std::vector<std::shared_ptr<TabPart>> parts;
+    parts.reserve(clip.parts.size());
+
+    for (const auto& part : clip.parts)
+        parts.push_back(withNumStrings(part, document->numStrings));
+
+    // Ensure section has at least one part
+    if (parts.empty())
+        parts.push_back(std::make_shared<TabPart>("Part 1", document->numStrings, 16));
+
+    auto pasted = std::make_shared<TabSection>(document->getSection(sectionIndex).name, std::move(parts));
+
+    {
+        const juce::SpinLock::ScopedLockType lock(documentLock);
+        auto& doc = editDocument();
+        doc.sections[(size_t)sectionIndex].swap(pasted);
+
+        // Reset current part index if this is the current section
+        if (sectionIndex == doc.currentSectionIndex)
+        {
+            if (doc.currentPartIndex >= doc.getSection(sectionIndex).getNumParts())
+                doc.currentPartIndex = 0;
+        }
+    }
+
+    journal.add(makeRecord(TabJournal::Op::swapSection, sectionIndex), std::move(pasted));
+
+    notifyListeners(TabChange::of(TabChange::structureChanged | TabChange::selectionChanged));
+}
+
+const TabSection* TabEngine::getCurrentSectionPtr() const
+{
+    int sectionIndex = document->currentSectionIndex;
+
+    if (sectionIndex >= 0 && sectionIndex < getNumSections())
+        return &document->getSection(sectionIndex);
+    return nullptr;
+}
+
+const TabPart* TabEngine::getCurrentPartPtr() const
+{
+    auto* section = getCurrentSectionPtr();
+    if (!section) return nullptr;
+
+    int partIndex = document->currentPartIndex;
+
+    if (partIndex >= 0 && partIndex < section->getNumParts())
+        return &section->getPart(partIndex);
+    return nullptr;
+}
+
+// Part management
+int TabEngine::getNumParts() const
+{
+    auto* section = getCurrentSectionPtr();
+    if (section)
+        return section->getNumParts();
+    return 0;
+}
+
+void TabEngine::addPart(const juce::String& name)
+{
+    if (!getCurrentSectionPtr()) return;
+
+    auto part = std::make_shared<TabPart>(name, document->numStrings, 16);
+
+    {
+        const juce::SpinLock::ScopedLockType lock(documentLock);
+        editSection(document->currentSectionIndex).parts.push_back(std::move(part));
+    }
+
+    journal.add(makeRecord(TabJournal::Op::insertPart, document->currentSectionIndex, getNumParts() - 1));
+
+    notifyListeners(TabChange::of(TabChange::structureChanged));
+}
+
+void TabEngine::removePart(int partIndex)
+{
+    auto* section = getCurrentSectionPtr();
+    if (!section) return;
+
+    if (partIndex >= 0 && partIndex < section->getNumParts() && section->getNumParts() > 1)
+    {
+        std::shared_ptr<TabPart> removed;
+
+        {
+            const juce::SpinLock::ScopedLockType lock(documentLock);
+            auto& parts = editSection(document->currentSectionIndex).parts;
+            removed = std::move(parts[(size_t)partIndex]);
+            parts.erase(parts.begin() + partIndex);
+
+            // Adjust current part index if needed
+            auto& doc = *document;
+            if (doc.currentPartIndex >= (int)parts.size())
+                doc.currentPartIndex = (int)parts.size() - 1;
+            if (doc.currentPartIndex < 0)
+                doc.currentPartIndex = 0;
+        }
+
+        journal.add(makeRecord(TabJournal::Op::removePart, document->currentSectionIndex, partIndex), std::move(removed));
+        notifyListeners(TabChange::of(TabChange::structureChanged | TabChange::selectionChanged));
+    }
+}
+
+void TabEngine::renamePart(int partIndex, const juce::String& newName)
+{
+    auto* section = getCurrentSectionPtr();
+    if (!section) return;
+
+    if (partIndex >= 0 && partIndex < section->getNumParts())
+    {
+        // Rename a copy so the old node can go into the journal
+        auto renamed = std::make_shared<TabPart>(section->getPart(partIndex));
+        renamed->name = newName;
+
+        {
+            const juce::SpinLock::ScopedLockType lock(documentLock);
+            editSection(document->currentSectionIndex).parts[(size_t)partIndex].swap(renamed);
+        }
+
+        journal.add(makeRecord(TabJournal::Op::swapPart, document->currentSectionIndex, partIndex), std::move(renamed));
+
+        notifyListeners(TabChange::of(TabChange::structureChanged));
+    }
+}
+
+juce::String TabEngine::getPartName(int partIndex) const
+{
+    auto* section = getCurrentSectionPtr();
+    if (!section) return "";
+
+    if (partIndex >= 0 && partIndex < section->getNumParts())
+        return section->getPart(partIndex).name;
+    return "";
+}
+
+void TabEngine::setCurrentPart(int partIndex)
+{
+    auto* section = getCurrentSectionPtr();
+    if (!section) return;
+
+    if (partIndex >= 0 && partIndex < section->getNumParts())
+    {
+        {
+            const juce::SpinLock::ScopedLockType lock(documentLock);
+            editDocument().currentPartIndex = partIndex;
+        }
+
+        notifyListeners(TabChange::of(TabChange::selectionChanged));
+    }
+}
+
+void TabEngine::clearPart(int partIndex)
+{
+    auto* section = getCurrentSectionPtr();
+    if (!section) return;
+
+    if (partIndex >= 0 && partIndex < section->getNumParts())
+    {
+        auto cleared = std::make_shared<TabPart>(section->getPart(partIndex).name, document->numStrings, 16);
+
+        {
+            const juce::SpinLock::ScopedLockType lock(documentLock);
+            editSection(document->currentSectionIndex).parts[(size_t)partIndex].swap(cleared);
+        }
+
+        journal.add(makeRecord(TabJournal::Op::swapPart, document->currentSectionIndex, partIndex), std::move(cleared));
+
+        notifyListeners(TabChange::of(TabChange::structureChanged));
+    }
+}
+
+std::shared_ptr<const TabPart> TabEngine::copyPart(int partIndex) const
+{
+    auto* section = getCurrentSectionPtr();
+    if (!section) return nullptr;
+
+    if (partIndex >= 0 && partIndex < section->getNumParts())
+        return section->parts[(size_t)partIndex];
+
+    return nullptr;
+}
+
+void TabEngine::pastePart(int partIndex, const std::shared_ptr<const TabPart>& clip)
+{
+    auto* section = getCurrentSectionPtr();
+    if (!section || clip == nullptr) return;
+
+    if (partIndex >= 0 && partIndex < section->getNumParts())
+    {
+        // The clipboard's part goes into the document as it is; editing it
+        // there copies it first, as with any other shared node
+        auto pasted = withNumStrings(std::const_pointer_cast<TabPart>(clip), document->numStrings);
+
+        {
+            const juce::SpinLock::ScopedLockType lock(documentLock);
+            editSection(document->currentSectionIndex).parts[(size_t)partIndex].swap(pasted);
+        }
+
+        journal.add(makeRecord(TabJournal::Op::swapPart, document->currentSectionIndex, partIndex), std::move(pasted));
+
+        notifyListeners(TabChange::of(TabChange::structureChanged));
+    }
+}
+
+void TabEngine::setNumColumns(int num)
+{
+    auto* current = getCurrentPartPtr();
+    if (!current) return;
+
+    auto resized = std::make_shared<TabPart>(current->name, document->numStrings, num);
+
+    {
+        const juce::SpinLock::ScopedLockType lock(documentLock);
+        editSection(document->currentSectionIndex).parts[(size_t)document->currentPartIndex].swap(resized);
+    }
+
+    journal.add(makeRecord(TabJournal::Op::swapPart, document->currentSectionIndex, document->currentPartIndex), std::move(resized));
+
+    notifyListeners(TabChange::of(TabChange::structureChanged));
+}
+
+int TabEngine::getNumColumns() const
+{
+    auto* part = getCurrentPartPtr();
+    if (part)
+        return part->getNumColumns();
+    return 0;
+}
+
+void TabEngine::setFret(int columnIndex, int stringIndex, int fret)
+{
+    auto* part = getCurrentPartPtr();
+    if (!part) return;
+
+    if (columnIndex >= 0 && columnIndex < part->getNumColumns())
+    {
+        recordCell(columnIndex, stringIndex);
+
+        {
+            const juce::SpinLock::ScopedLockType lock(documentLock);
+            editCurrentPart()->getColumn(columnIndex).setFret(stringIndex, fret);
+        }
+
+        notifyListeners(cellsInCurrentPart({ columnIndex, columnIndex + 1 }, { stringIndex, stringIndex + 1 }));
+    }
+}
+
+int TabEngine::getFret(int columnIndex, int stringIndex) const
+{
+    auto* part = getCurrentPartPtr();
+    if (!part) return -1;
+
+    if (columnIndex >= 0 && columnIndex < part->getNumColumns())
+        return part->getColumn(columnIndex).getFret(stringIndex);
+    return -1;
+}
+
+void TabEngine::setTechnique(int columnIndex, int stringIndex, Technique tech, bool beforeFret)
+{
+    auto* part = getCurrentPartPtr();
+    if (!part) return;
+
+    if (columnIndex >= 0 && columnIndex < part->getNumColumns())
+    {
+        recordCell(columnIndex, stringIndex);
+
+        {
+            const juce::SpinLock::ScopedLockType lock(documentLock);
+            editCurrentPart()->getColumn(columnIndex).setTechnique(stringIndex, tech, beforeFret);
+        }
+
+        notifyListeners(cellsInCurrentPart({ columnIndex, columnIndex + 1 }, { stringIndex, stringIndex + 1 }));
+    }
+}
+
+Technique TabEngine::getTechnique(int columnIndex, int stringIndex) const
+{
+    auto* part = getCurrentPartPtr();
+    if (!part) return Technique::None;
+
+    if (columnIndex >= 0 && columnIndex < part->getNumColumns())
+        return part->getColumn(columnIndex).getTechnique(stringIndex);
+    return Technique::None;
+}
+
+bool TabEngine::isTechniqueBeforeFret(int columnIndex, int stringIndex) const
+{
+    auto* part = getCurrentPartPtr();
+    if (!part) return false;
+
+    if (columnIndex >= 0 && columnIndex < part->getNumColumns())
+        return part->getColumn(columnIndex).isTechniqueBeforeFret(stringIndex);
+    return false;
+}
+
+void TabEngine::insertColumn(int beforeIndex)
+{
+    auto* part = getCurrentPartPtr();
+    if (!part) return;
+
+    if (beforeIndex >= 0 && beforeIndex <= part->getNumColumns())
+    {
+        {
+            const juce::SpinLock::ScopedLockType lock(documentLock);
+            editCurrentPart()->insertColumn(beforeIndex);
+        }
+
+        journal.add(makeRecord(TabJournal::Op::insertColumn, document->currentSectionIndex, document->currentPartIndex, beforeIndex));
+
+        notifyListeners(columnsInCurrentPart(beforeIndex));
+    }
+}
+
+void TabEngine::insertBarLine(int beforeIndex)
+{
+    auto* part = getCurrentPartPtr();
+    if (!part) return;
+
+    if (beforeIndex >= 0 && beforeIndex <= part->getNumColumns())
+    {
+        {
+            const juce::SpinLock::ScopedLockType lock(documentLock);
+            editCurrentPart()->insertColumn(beforeIndex, true);
+        }
+
+        journal.add(makeRecord(TabJournal::Op::insertColumn, document->currentSectionIndex, document->currentPartIndex, beforeIndex));
+
+        notifyListeners(columnsInCurrentPart(beforeIndex));
+    }
+}
+
+void TabEngine::deleteColumn(int index)
+{
+    auto* part = getCurrentPartPtr();
+    if (!part) return;
+
+    if (index >= 0 && index < part->getNumColumns() && part->getNumColumns() > 1)
+    {
+        // Undoing re-inserts an empty column and then restores its cells
+        for (int str = 0; str < part->getNumStrings(); ++str)
+            if (!part->getColumn(index)[str].isEmpty())
+                recordCell(index, str);
+
+        auto record = makeRecord(TabJournal::Op::removeColumn, document->currentSectionIndex, document->currentPartIndex, index);
+        record.detail = part->isBarLine(index) ? 1 : 0;
+        journal.add(record);
+
+        {
+            const juce::SpinLock::ScopedLockType lock(documentLock);
+            editCurrentPart()->removeColumn(index);
+        }
+
+        notifyListeners(columnsInCurrentPart(index));
+    }
+}
+
+void TabEngine::clearColumn(int index)
+{
+    auto* part = getCurrentPartPtr();
+    if (!part) return;
+
+    if (index >= 0 && index < part->getNumColumns())
+    {
+        for (int str = 0; str < part->getNumStrings(); ++str)
+            if (!part->getColumn(index)[str].isEmpty())
+                recordCell(index, str);
+
+        auto record = makeRecord(TabJournal::Op::setBarLine, document->currentSectionIndex, document->currentPartIndex, index);
+        record.detail = part->isBarLine(index) ? 1 : 0;
+        journal.add(record);
+
+        {
+            const juce::SpinLock::ScopedLockType lock(documentLock);
+            editCurrentPart()->clearColumn(index);
+        }
+
+        notifyListeners(cellsInCurrentPart({ index, index + 1 }, { 0, document->numStrings }));
+    }
+}
+
+bool TabEngine::isColumnBarLine(int index) const
+{
+    auto* part = getCurrentPartPtr();
+    if (!part) return false;
+
+    if (index >= 0 && index < part->getNumColumns())
+        return part->isBarLine(index);
+    return false;
+}
+
+//==============================================================================
+template <typename EditFn>
+void TabEngine::editRange(juce::Range<int> columns, juce::Range<int> strings, EditFn&& edit)
+{
+    auto* current = getCurrentPartPtr();
+    if (!current) return;
+
+    columns = columns.getIntersectionWith({ 0, current->getNumColumns() });
+    strings = strings.getIntersectionWith({ 0, current->getNumStrings() });
+
+    if (columns.isEmpty() || strings.isEmpty())
+        return;
+
+    // The edit is made on a copy of the part, off to the side, with a record
+    // for every cell it changes. The copy shares all but the chunks in the
+    // range. Only swapping it in takes the lock, so snapshots never wait on
+    // the edit or the journal.
+    auto edited = std::make_shared<TabPart>(*current);
+    auto record = makeRecord(TabJournal::Op::setCell, document->currentSectionIndex, document->currentPartIndex);
+    std::vector<TabJournal::Record> records;
+
+    edited->columns.forEachColumn(columns.getStart(), columns.getEnd(), [&](TabColumn column, int col)
+    {
+        for (int str = strings.getStart(); str < strings.getEnd(); ++str)
+        {
+            auto& cell = column[str];
+            auto old = cell;
+            edit(cell, col, str);
+
+            // Only cells that actually changed cost a journal record
+            if (cell != old)
+            {
+                record.column = col;
+                record.detail = (juce::int8)str;
+                record.cell = old;
+                records.push_back(record);
+            }
+        }
+    });
+
+    if (records.empty())
+        return;
+
+    {
+        const juce::SpinLock::ScopedLockType lock(documentLock);
+        editSection(document->currentSectionIndex).parts[(size_t)document->currentPartIndex].swap(edited);
+    }
+
+    for (const auto& r : records)
+        journal.add(r);
+
+    notifyListeners(cellsInCurrentPart(columns, strings));
+}
+
+TabCellBlock TabEngine::copyRange(juce::Range<int> columns, juce::Range<int> strings) const
+{
+    TabCellBlock block;
+
+    auto* part = getCurrentPartPtr();
+    if (!part) return block;
+
+    columns = columns.getIntersectionWith({ 0, part->getNumColumns() });
+    strings = strings.getIntersectionWith({ 0, part->getNumStrings() });
+
+    if (columns.isEmpty() || strings.isEmpty())
+        return block;
+
+    block.numColumns = columns.getLength();
+    block.numStrings = strings.getLength();
+    block.cells.reserve((size_t)(block.numColumns * block.numStrings));
+
+    part->columns.forEachColumn(columns.getStart(), columns.getEnd(), [&](ConstTabColumn column, int)
+    {
+        for (int str = strings.getStart(); str < strings.getEnd(); ++str)
+            block.cells.push_back(column[str]);
+    });
+
+    return block;
+}
+
+void TabEngine::pasteRange(int column, int stringIndex, const TabCellBlock& block)
+{
+    editRange({ column, column + block.numColumns }, { stringIndex, stringIndex + block.numStrings },
+              [&](TabCell& cell, int col, int str) { cell = block.getCell(col - column, str - stringIndex); });
+}
+
+void TabEngine::clearRange(juce::Range<int> columns, juce::Range<int> strings)
+{
+    editRange(columns, strings, [](TabCell& cell, int, int) { cell = TabCell(); });
+}
+
+void TabEngine::shiftFrets(juce::Range<int> columns, juce::Range<int> strings, int semitones)
+{
+    editRange(columns, strings, [semitones](TabCell& cell, int, int)
+    {
+        // Mutes only use fret 0 as a placeholder, so they stay put
+        if (!cell.isEmpty() && cell.getTechnique() != Technique::Mute)
+            cell.setFret(juce::jlimit(0, TabCell::maxFret, cell.fret + semitones));
+    });
+}
+
+void TabEngine::setTechniqueRange(juce::Range<int> columns, juce::Range<int> strings, Technique tech, bool beforeFret)
+{
+    editRange(columns, strings, [tech, beforeFret](TabCell& cell, int, int)
+    {
+        if (!cell.isEmpty())
+            cell.setTechnique(tech, beforeFret);
+    });
+}
+
+void TabEngine::duplicateColumns(juce::Range<int> columns)
+{
+    auto* current = getCurrentPartPtr();
+    if (!current) return;
+
+    columns = columns.getIntersectionWith({ 0, current->getNumColumns() });
+    if (columns.isEmpty())
+        return;
+
+    int numStrings = current->getNumStrings();
+    int numCopies = columns.getLength();
+    int destination = columns.getEnd();
+
+    // Built off to the side like editRange, with the copies inserted in one
+    // splice. Undoing clears the copied cells first and then removes the
+    // columns.
+    auto edited = std::make_shared<TabPart>(*current);
+    edited->columns.insertCopies(destination, columns.getStart(), numCopies);
+
+    auto record = makeRecord(TabJournal::Op::insertColumn, document->currentSectionIndex, document->currentPartIndex);
+    std::vector<TabJournal::Record> records;
+
+    for (int i = 0; i < numCopies; ++i)
+    {
+        record.column = destination + i;
+        records.push_back(record);
+    }
+
+    record.op = TabJournal::Op::setCell;
+    record.cell = TabCell();
+
+    static_cast<const TabPart&>(*edited).columns.forEachColumn(destination, destination + numCopies, [&](ConstTabColumn column, int col)
+    {
+        for (int str = 0; str < numStrings; ++str)
+        {
+            if (!column[str].isEmpty())
+            {
+                record.column = col;
+                record.detail = (juce::int8)str;
+                records.push_back(record);
+            }
+        }
+    });
+
+    {
+        const juce::SpinLock::ScopedLockType lock(documentLock);
+        editSection(document->currentSectionIndex).parts[(size_t)document->currentPartIndex].swap(edited);
+    }
+
+    for (const auto& r : records)
+        journal.add(r);
+
+    notifyListeners(columnsInCurrentPart(destination));
+}
+
+//==============================================================================
+TabJournal::Record TabEngine::makeRecord(TabJournal::Op op, int sectionIndex, int partIndex, int column) const
+{
+    TabJournal::Record record;
+    record.op = op;
+    record.column = column;
+    record.section = sectionIndex;
+    record.part = partIndex;
+    return record;
+}
+
+void TabEngine::recordCell(int columnIndex, int stringIndex)
+{
+    auto* part = getCurrentPartPtr();
+
+    if (part != nullptr && stringIndex >= 0 && stringIndex < part->getNumStrings())
+    {
+        auto record = makeRecord(TabJournal::Op::setCell, document->currentSectionIndex, document->currentPartIndex, columnIndex);
+        record.detail = (juce::int8)stringIndex;
+        record.cell = part->getColumn(columnIndex)[stringIndex];
+        journal.add(record);
+    }
+}
+
+bool TabEngine::undo()
+{
+    return replay(journal.undoStack, journal.redoStack);
+}
+
+bool TabEngine::redo()
+{
+    return replay(journal.redoStack, journal.undoStack);
+}
+
+void TabEngine::clearUndoHistory()
+{
+    journal.clear();
+}
+
+void TabEngine::setUndoMemoryLimit(size_t bytes)
+{
+    journal.memoryLimit = bytes;
+    journal.trimToLimit();
+}
+
+bool TabEngine::replay(TabJournal::Stack& from, TabJournal::Stack& to)
+{
+    jassert(transactionDepth == 0);
+    journal.closeStep();
+
+    if (from.steps.empty())
+        return false;
+
+    auto step = from.steps.back();
+    from.steps.pop_back();
+    from.bytes -= step.bytes;
+    to.steps.emplace_back();
+
+    TabChange change;
+
+    {
+        const juce::SpinLock::ScopedLockType lock(documentLock);
+
+        // Revert the step's records newest first; each one turns into its own
+        // inverse, which lands on the other stack in the order it will need
+        for (size_t i = 0; i < step.numRecords; ++i)
+        {
+            auto record = from.records.back();
+            from.records.pop_back();
+
+            std::shared_ptr<void> node;
+            if (TabJournal::hasNode(record.op))
+            {
+                node = std::move(from.nodes.back());
+                from.nodes.pop_back();
+            }
+
+            change.merge(revert(record, node));
+            to.push(record, std::move(node));
+        }
+
+        validateSelection(editDocument());
+    }
+
+    journal.trimToLimit();
+    notifyListeners(change);
+    return true;
+}
+
+TabChange TabEngine::revert(TabJournal::Record& record, std::shared_ptr<void>& node)
+{
+    using Op = TabJournal::Op;
+
+    int s = record.section;
+    int p = record.part;
+    int col = record.column;
+
+    switch (record.op)
+    {
+        case Op::setCell:
+        {
+            auto column = editPart(s, p).getColumn(col);
+            std::swap(column[record.detail], record.cell);
+            return TabChange::cells(s, p, { col, col + 1 }, { record.detail, record.detail + 1 });
+        }
+
+        case Op::setBarLine:
+        {
+            auto& part = editPart(s, p);
+            bool wasBarLine = part.isBarLine(col);
+            part.setBarLine(col, record.detail != 0);
+            record.detail = wasBarLine ? 1 : 0;
+            return TabChange::cells(s, p, { col, col + 1 }, { 0, part.getNumStrings() });
+        }
+
+        case Op::insertColumn:
+        {
+            auto& part = editPart(s, p);
+            record.detail = part.isBarLine(col) ? 1 : 0;
+            part.removeColumn(col);
+            record.op = Op::removeColumn;
+            return TabChange::columnsFrom(s, p, col);
+        }
+
+        case Op::removeColumn:
+        {
+            editPart(s, p).insertColumn(col, record.detail != 0);
+            record.op = Op::insertColumn;
+            return TabChange::columnsFrom(s, p, col);
+        }
+
+        case Op::swapSection:
+        {
+            auto section = std::static_pointer_cast<TabSection>(node);
+            editDocument().sections[(size_t)s].swap(section);
+            node = std::move(section);
+            return TabChange::of(TabChange::structureChanged);
+        }
+
+        case Op::insertSection:
+        {
+            auto& sections = editDocument().sections;
+            node = std::move(sections[(size_t)s]);
+            sections.erase(sections.begin() + s);
+            record.op = Op::removeSection;
+            return TabChange::of(TabChange::structureChanged | TabChange::selectionChanged);
+        }
+
+        case Op::removeSection:
+        {
+            auto& sections = editDocument().sections;
+            sections.insert(sections.begin() + s, std::static_pointer_cast<TabSection>(node));
+            node.reset();
+            record.op = Op::insertSection;
+            return TabChange::of(TabChange::structureChanged | TabChange::selectionChanged);
+        }
+
+        case Op::swapPart:
+        {
+            auto part = std::static_pointer_cast<TabPart>(node);
+            editSection(s).parts[(size_t)p].swap(part);
+            node = std::move(part);
+            return TabChange::of(TabChange::structureChanged);
+        }
+
+        case Op::insertPart:
+        {
+            auto& parts = editSection(s).parts;
+            node = std::move(parts[(size_t)p]);
+            parts.erase(parts.begin() + p);
+            record.op = Op::removePart;
+            return TabChange::of(TabChange::structureChanged | TabChange::selectionChanged);
+        }
+
+        case Op::removePart:
+        {
+            auto& parts = editSection(s).parts;
+            parts.insert(parts.begin() + p, std::static_pointer_cast<TabPart>(node));
+            node.reset();
+            record.op = Op::insertPart;
+            return TabChange::of(TabChange::structureChanged | TabChange::selectionChanged);
+        }
+
+        case Op::swapDocument:
+        {
+            auto other = std::static_pointer_cast<TabDocument>(node);
+            document.swap(other);
+            node = std::move(other);
+            return TabChange::everything();
+        }
+    }
+
+    jassertfalse;
+    return {};
+}
+
+std::unique_ptr<juce::XmlElement> TabEngine::saveToXML() const
+{
+    return saveToXML(*getSnapshot());
+}
+
+std::unique_ptr<juce::XmlElement> TabEngine::saveToXML(const TabDocument& doc)
+{
+    auto xml = std::make_unique<juce::XmlElement>("TabData");
+
+    xml->setAttribute("numStrings", doc.numStrings);
+    xml->setAttribute("rootNote", NoteUtils::getNoteName(doc.rootNote));
+    xml->setAttribute("tuningType", (int)doc.tuningType);
+    xml->setAttribute("currentSection", doc.currentSectionIndex);
+    xml->setAttribute("currentPart", doc.currentPartIndex);
+
+    // Save custom tuning notes
+    juce::String customNotes, customPitches;
+    for (int i = 0; i < doc.tuning.getNumStrings(); ++i)
+    {
+        if (i > 0)
+        {
+            customNotes += ",";
+            customPitches += ",";
+        }
+        customNotes += NoteUtils::getNoteName(doc.tuning.getPitch(i));
+        customPitches += juce::String(doc.tuning.getPitch(i));
+    }
+    xml->setAttribute("customTuning", customNotes);
+    xml->setAttribute("customTuningPitches", customPitches);
+
+    // Save all sections
+    for (int s = 0; s < doc.getNumSections(); ++s)
+    {
+        auto decodedSection = decoded(doc.sections[(size_t)s], doc.numStrings);
+        const auto& section = *decodedSection;
+
+        auto* sectionXml = xml->createNewChildElement("Section");
+        sectionXml->setAttribute("index", s);
+        sectionXml->setAttribute("name", section.name);
+
+        // Save all parts in this section
+        for (int p = 0; p < section.getNumParts(); ++p)
+        {
+            const auto& part = section.getPart(p);
+
+            auto* partXml = sectionXml->createNewChildElement("Part");
+            partXml->setAttribute("index", p);
+            partXml->setAttribute("name", part.name);
+            partXml->setAttribute("numColumns", part.getNumColumns());
+
+            for (int col = 0; col < part.getNumColumns(); ++col)
+            {
+                auto* columnXml = partXml->createNewChildElement("Column");
+                columnXml->setAttribute("index", col);
+                columnXml->setAttribute("isBarLine", part.isBarLine(col));
+
+                auto column = part.getColumn(col);
+                for (int str = 0; str < doc.numStrings; ++str)
+                {
+                    int fret = column.getFret(str);
+                    if (fret >= 0)
+                    {
+                        auto* noteXml = columnXml->createNewChildElement("Note");
+                        noteXml->setAttribute("string", str);
+                        noteXml->setAttribute("fret", fret);
+                        noteXml->setAttribute("technique", (int)column.getTechnique(str));
+                    }
+                }
+            }
+        }
+    }
+
+    return xml;
+}
+
+template <typename Element>
+void TabEngine::readDocumentAttributes(TabDocument& doc, const Element& element)
+{
+    doc.numStrings = juce::jlimit(1, TabColumnSequence::maxStrings, element.getIntAttribute("numStrings", 6));
+    doc.rootNote = juce::jmax(0, NoteUtils::getNoteIndex(element.getStringAttribute("rootNote", "E")));
+    doc.tuningType = (TuningType)juce::jlimit(0, (int)TuningType::Custom, element.getIntAttribute("tuningType", (int)TuningType::Standard));
+    doc.currentSectionIndex = element.getIntAttribute("currentSection", 0);
+    doc.currentPartIndex = element.getIntAttribute("currentPart", 0);
+
+    // Load custom tuning. Older states only have note names, so those
+    // strings are placed in the octave of standard tuning.
+    juce::String customNotes = element.getStringAttribute("customTuning");
+    juce::String customPitches = element.getStringAttribute("customTuningPitches");
+    if (customPitches.isNotEmpty() || customNotes.isNotEmpty())
+    {
+        juce::StringArray tokens;
+        tokens.addTokens(customPitches.isNotEmpty() ? customPitches : customNotes, ",", "");
+
+        auto reference = GuitarTuning::createStandard(4, GuitarTuning::maxStrings);
+        doc.tuning = GuitarTuning();
+        doc.tuning.numStrings = juce::jmin(tokens.size(), GuitarTuning::maxStrings);
+
+        for (int i = 0; i < doc.tuning.getNumStrings(); ++i)
+        {
+            if (customPitches.isNotEmpty())
+                doc.tuning.setPitch(i, juce::jlimit(0, 127, tokens[i].getIntValue()));
+            else
+                doc.tuning.setPitch(i, NoteUtils::getNearestPitch(juce::jmax(0, NoteUtils::getNoteIndex(tokens[i])), reference.getPitch(i)));
+        }
+    }
+    else
+    {
+        // Fallback to updating tuning
+        updateTuning(doc);
+    }
+
+    // Retuning relies on every string having a pitch
+    if (doc.tuning.getNumStrings() != doc.numStrings)
+        doc.tuning.resize(doc.numStrings);
+}
+
+// One thread for every core but the one doing the asking, shared by every
+// TabEngine. It's only created by the first job big enough to need it, so
+// plugin instances that never load anything large never start a thread, and
+// it stays up from then on until JUCE shuts down.
+struct TabWorkerPool : private juce::DeletedAtShutdown
+{
+    ~TabWorkerPool() override { clearSingletonInstance(); }
+
+    static int getNumWorkers() { return juce::jmax(1, juce::SystemStats::getNumCpus() - 1); }
+
+    juce::ThreadPool pool { getNumWorkers() };
+
+    JUCE_DECLARE_SINGLETON(TabWorkerPool, false)
+};
+
+JUCE_IMPLEMENT_SINGLETON(TabWorkerPool)
+
+static std::atomic<int> maxThreadsSetting { 0 };
+
+void TabEngine::setMaxThreads(int numThreads)
+{
+    maxThreadsSetting = juce::jmax(0, numThreads);
+}
+
+// Calls fn(i) for every i in [0, count), spread over up to maxThreads
+// threads including the calling one, and returns once all of them are done.
+// Indices are handed out one at a time, so fn should only touch what belongs
+// to its own index. Helpers come from the shared TabWorkerPool, so this only
+// queues jobs; it never starts threads of its own.
+template <typename Fn>
+static void parallelFor(size_t count, size_t maxThreads, Fn&& fn)
+{
+    auto numThreads = juce::jmin(juce::jmin(count, maxThreads), (size_t)TabWorkerPool::getNumWorkers() + 1,
+                                 (size_t)juce::jmax(1, juce::SystemStats::getNumCpus()));
+
+    if (auto setting = maxThreadsSetting.load(); setting > 0)
+        numThreads = juce::jmin(numThreads, (size_t)setting);
+
+    if (numThreads <= 1)
+    {
+        for (size_t i = 0; i < count; ++i)
+            fn(i);
+
+        return;
+    }
+
+    auto& workers = *TabWorkerPool::getInstance();
+
+    std::atomic<size_t> next { 0 };
+    std::atomic<size_t> helpersRunning { numThreads - 1 };
+    juce::WaitableEvent helpersDone;
+
+    auto work = [&]
+    {
+        for (auto i = next++; i < count; i = next++)
+            fn(i);
+    };
+
+    for (size_t t = 1; t < numThreads; ++t)
+    {
+        workers.pool.addJob([&]
+        {
+            work();
+
+            if (--helpersRunning == 0)
+                helpersDone.signal();
+        });
+    }
+
+    work();
+    helpersDone.wait();
+}
+
+// Reads one <Section> element. Its columns come from an arena of its own, so
+// sections can be read on different threads.
+static std::shared_ptr<TabSection> readSectionXml(const juce::XmlElement& sectionXml, int numStrings)
+{
+    size_t numChunks = 0;
+    for (auto* partXml : sectionXml.getChildWithTagNameIterator("Part"))
+        numChunks += TabColumnSequence::ChunkArena::chunksNeeded(partXml->getIntAttribute("numColumns", 16));
+
+    TabColumnSequence::ChunkArena arena(numChunks);
+
+    juce::String sectionName = sectionXml.getStringAttribute("name", "Untitled");
+
+    std::vector<std::shared_ptr<TabPart>> parts;
+    parts.reserve((size_t)sectionXml.getNumChildElements());
+
+    // Load parts
+    for (auto* partXml : sectionXml.getChildIterator())
+    {
+        if (partXml->hasTagName("Part"))
+        {
+            juce::String partName = partXml->getStringAttribute("name", "Part 1");
+            int numCols = partXml->getIntAttribute("numColumns", 16);
+
+            parts.push_back(std::make_shared<TabPart>(partName, TabColumnSequence(numStrings, numCols, arena)));
+            auto& part = *parts.back();
+
+            for (auto* columnXml : partXml->getChildIterator())
+            {
+                if (columnXml->hasTagName("Column"))
+                {
+                    int colIndex = columnXml->getIntAttribute("index");
+                    bool isBarLine = columnXml->getBoolAttribute("isBarLine", false);
+
+                    if (colIndex >= 0 && colIndex < numCols)
+                    {
+                        part.setBarLine(colIndex, isBarLine);
+                        auto column = part.getColumn(colIndex);
+
+                        for (auto* noteXml : columnXml->getChildIterator())
+                        {
+                            if (noteXml->hasTagName("Note"))
+                            {
+                                int str = noteXml->getIntAttribute("string");
+                                int fret = noteXml->getIntAttribute("fret");
+                                int tech = noteXml->getIntAttribute("technique", (int)Technique::None);
+                                column.setFret(str, fret);
+                                column.setTechnique(str, (Technique)tech);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Ensure section has at least one part
+    if (parts.empty())
+        parts.push_back(std::make_shared<TabPart>("Part 1", numStrings, 16));
+
+    return std::make_shared<TabSection>(sectionName, std::move(parts));
+}
+
+void TabEngine::loadFromXML(const juce::XmlElement& xml)
+{
+    if (xml.hasTagName("TabData"))
+    {
+        // Build the new document off to the side and swap it in at the end
+        auto loaded = std::make_shared<TabDocument>();
+        auto& doc = *loaded;
+
+        readDocumentAttributes(doc, xml);
+
+        std::vector<const juce::XmlElement*> sectionXmls;
+        size_t numColumns = 0;
+
+        for (auto* sectionXml : xml.getChildWithTagNameIterator("Section"))
+        {
+            sectionXmls.push_back(sectionXml);
+
+            for (auto* partXml : sectionXml->getChildWithTagNameIterator("Part"))
+                numColumns += (size_t)juce::jmax(0, partXml->getIntAttribute("numColumns", 16));
+        }
+
+        // Sections don't depend on each other, so they're read in parallel,
+        // with a thread for every few thousand columns. Each lands in its own
+        // slot, so the result is the same as reading them in order.
+        doc.sections.resize(sectionXmls.size());
+
+        parallelFor(sectionXmls.size(), numColumns / 4096 + 1, [&](size_t i)
+        {
+            doc.sections[i] = readSectionXml(*sectionXmls[i], doc.numStrings);
+        });
+
+        loadDocument(std::move(loaded));
+    }
+}
+
+void TabEngine::loadDocument(std::shared_ptr<TabDocument> loaded)
+{
+    // Usually already done by readFile, on the thread that read the file
+    prepareLoadedDocument(*loaded);
+
+    // The old document moves into the journal, so loading can be undone
+    journal.add(makeRecord(TabJournal::Op::swapDocument, 0), commitDocument(std::move(loaded)));
+    notifyListeners(TabChange::everything());
+}
+
+void TabEngine::prepareLoadedDocument(TabDocument& doc)
+{
+    // Ensure we have at least one section
+    if (doc.sections.empty())
+        doc.sections.push_back(std::make_shared<TabSection>("Intro", doc.numStrings, 16));
+
+    // Validate current indices
+    if (doc.currentSectionIndex >= doc.getNumSections())
+        doc.currentSectionIndex = 0;
+
+    if (doc.currentSectionIndex >= 0 && doc.currentSectionIndex < doc.getNumSections())
+    {
+        // Sections opened lazily are decoded once selected, starting with this one
+        auto& current = doc.sections[(size_t)doc.currentSectionIndex];
+        current = decoded(current, doc.numStrings);
+
+        if (doc.currentPartIndex >= current->getNumParts())
+            doc.currentPartIndex = 0;
+    }
+}
+
+//==============================================================================
+// Pulls the tags of a .tabsaver file off a stream one at a time, so a file can
+// be read without building a DOM first. It understands what the TabData
+// schema uses: elements, attributes, the predefined entities and character
+// references. Text, comments, CDATA, processing instructions and DOCTYPEs are
+// skipped.
+class TabXmlStreamReader
+{
+public:
+    enum class Token { startTag, endTag, end, error };
+
+    explicit TabXmlStreamReader(juce::InputStream& source) : input(source), buffer(bufferSize) {}
+
+    Token next()
+    {
+        for (;;)
+        {
+            int c = skipTo('<');
+            if (c < 0)
+                return Token::end;
+
+            c = read();
+
+            if (c == '?')
+            {
+                if (!skipPast("?>"))
+                    return Token::error;
+            }
+            else if (c == '!')
+            {
+                if (!skipDeclaration())
+                    return Token::error;
+            }
+            else if (c == '/')
+            {
+                if (!readName(read(), name))
+                    return Token::error;
+
+                c = skipWhitespace();
+                return c == '>' ? Token::endTag : Token::error;
+            }
+            else
+            {
+                return readStartTag(c) ? Token::startTag : Token::error;
+            }
+        }
+    }
+
+    const std::string& getName() const { return name; }
+    bool isEmptyElement() const { return emptyElement; }
+
+    // Same defaults and parsing rules as juce::XmlElement's accessors, so
+    // code can be written once for both
+    juce::String getStringAttribute(const char* attributeName, const juce::String& defaultValue = {}) const
+    {
+        if (auto* value = find(attributeName))
+            return juce::String::fromUTF8(value->data(), (int)value->size());
+
+        return defaultValue;
+    }
+
+    int getIntAttribute(const char* attributeName, int defaultValue = 0) const
+    {
+        if (auto* value = find(attributeName))
+            return std::atoi(value->c_str());
+
+        return defaultValue;
+    }
+
+    bool getBoolAttribute(const char* attributeName, bool defaultValue = false) const
+    {
+        if (auto* value = find(attributeName))
+        {
+            auto first = value->empty() ? 0 : value->front();
+            return first == '1' || first == 't' || first == 'y' || first == 'T' || first == 'Y';
+        }
+
+        return defaultValue;
+    }
+
+private:
+    static constexpr size_t bufferSize = 1 << 16;
+
+    juce::InputStream& input;
+    std::vector<char> buffer;
+    size_t position = 0, available = 0;
+
+    std::string name;
+    std::vector<std::pair<std::string, std::string>> attributes; // Reused between tags
+    size_t numAttributes = 0;
+    bool emptyElement = false;
+
+    int read()
+    {
+        if (position == available)
+        {
+            position = 0;
+            available = (size_t)juce::jmax(0, input.read(buffer.data(), (int)bufferSize));
+
+            if (available == 0)
+                return -1;
+        }
+
+        return (unsigned char)buffer[position++];
+    }
+
+    int skipTo(char target)
+    {
+        for (;;)
+        {
+            int c = read();
+            if (c < 0 || c == target)
+                return c;
+        }
+    }
+
+    int skipWhitespace()
+    {
+        int c = read();
+        while (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+            c = read();
+        return c;
+    }
+
+    bool skipPast(const char* terminator)
+    {
+        const auto length = std::strlen(terminator);
+        size_t matched = 0;
+
+        while (matched < length)
+        {
+            int c = read();
+            if (c < 0)
+                return false;
+
+            matched = c == terminator[matched] ? matched + 1 : (c == terminator[0] ? 1 : 0);
+        }
+
+        return true;
+    }
+
+    bool skipDeclaration()
+    {
+        int c = read();
+
+        if (c == '-')
+            return read() == '-' && skipPast("-->");
+
+        if (c == '[')
+            return skipPast("]]>");
+
+        // DOCTYPE, possibly with an internal subset in brackets
+        for (int depth = 0; c >= 0; c = read())
+        {
+            if (c == '[')
+                ++depth;
+            else if (c == ']')
+                --depth;
+            else if (c == '>' && depth <= 0)
+                return true;
+        }
+
+        return false;
+    }
+
+    static bool isNameChar(int c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+            || c == '_' || c == ':' || c == '-' || c == '.' || c >= 0x80;
+    }
+
+    // Reads a name starting with first; returns false if there isn't one.
+    // The character after the name is pushed back.
+    bool readName(int first, std::string& target)
+    {
+        target.clear();
+
+        if (!isNameChar(first) || first == '-' || first == '.' || (first >= '0' && first <= '9'))
+            return false;
+
+        int c = first;
+        while (isNameChar(c))
+        {
+            target += (char)c;
+            c = read();
+        }
+
+        if (c >= 0)
+            --position;
+
+        return true;
+    }
+
+    bool readStartTag(int first)
+    {
+        numAttributes = 0;
+        emptyElement = false;
+
+        if (!readName(first, name))
+            return false;
+
+        for (;;)
+        {
+            int c = skipWhitespace();
+
+            if (c == '>')
+                return true;
+
+            if (c == '/')
+                return emptyElement = (read() == '>');
+
+            if (numAttributes == attributes.size())
+                attributes.emplace_back();
+
+            auto& attribute = attributes[numAttributes++];
+
+            if (!readName(c, attribute.first) || skipWhitespace() != '=')
+                return false;
+
+            int quote = skipWhitespace();
+            if (quote != '"' && quote != '\'')
+                return false;
+
+            if (!readValue(quote, attribute.second))
+                return false;
+        }
+    }
+
+    bool readValue(int quote, std::string& value)
+    {
+        value.clear();
+
+        for (;;)
+        {
+            int c = read();
+
+            if (c < 0 || c == '<')
+                return false;
+
+            if (c == quote)
+                return true;
+
+            if (c == '&')
+            {
+                if (!readEntity(value))
+                    return false;
+            }
+            else
+            {
+                value += (char)c;
+            }
+        }
+    }
+
+    bool readEntity(std::string& value)
+    {
+        char entity[12];
+        size_t length = 0;
+
+        for (int c = read(); c != ';'; c = read())
+        {
+            if (c < 0 || length == sizeof(entity) - 1)
+                return false;
+
+            entity[length++] = (char)c;
+        }
+
+        entity[length] = 0;
+
+        if (std::strcmp(entity, "amp") == 0)  { value += '&';  return true; }
+        if (std::strcmp(entity, "lt") == 0)   { value += '<';  return true; }
+        if (std::strcmp(entity, "gt") == 0)   { value += '>';  return true; }
+        if (std::strcmp(entity, "quot") == 0) { value += '"';  return true; }
+        if (std::strcmp(entity, "apos") == 0) { value += '\''; return true; }
+
+        if (entity[0] != '#' || length < 2)
+            return false;
+
+        bool hex = entity[1] == 'x' || entity[1] == 'X';
+        char* end = nullptr;
+        auto code = std::strtoul(entity + (hex ? 2 : 1), &end, hex ? 16 : 10);
+
+        if (end != entity + length || code == 0 || code > 0x10ffff)
+            return false;
+
+        char utf8[4];
+        auto numBytes = juce::CharPointer_UTF8::getBytesRequiredFor((juce::juce_wchar)code);
+        juce::CharPointer_UTF8 dest(utf8);
+        dest.write((juce::juce_wchar)code);
+        value.append(utf8, numBytes);
+        return true;
+    }
+
+    const std::string* find(const char* attributeName) const
+    {
+        for (size_t i = 0; i < numAttributes; ++i)
+            if (attributes[i].first == attributeName)
+                return &attributes[i].second;
+
+        return nullptr;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE (TabXmlStreamReader)
+};
+
+std::shared_ptr<TabDocument> TabEngine::readFromStream(juce::InputStream& input, const ProgressCallback& progress)
+{
+    using Token = TabXmlStreamReader::Token;
+    TabXmlStreamReader reader(input);
+
+    // Anything that doesn't open with a TabData element is turned away
+    // before the rest of it is read
+    if (reader.next() != Token::startTag || reader.getName() != "TabData")
+        return nullptr;
+
+    auto loaded = std::make_shared<TabDocument>();
+    auto& doc = *loaded;
+
+    readDocumentAttributes(doc, reader);
+
+    if (reader.isEmptyElement())
+        return loaded;
+
+    // The open elements, TabData first. Known ones are those the schema
+    // gives a meaning to where they are, and closing them finishes them off.
+    struct OpenElement
+    {
+        std::string name;
+        bool known;
+    };
+
+    std::vector<OpenElement> open { { reader.getName(), true } };
+
+    auto totalLength = input.getTotalLength();
+    int tagsUntilProgress = 0;
+
+    juce::String sectionName;
+    std::vector<std::shared_ptr<TabPart>> parts;
+    TabPart* part = nullptr;
+    int columnIndex = -1;
+
+    auto closeElement = [&](size_t depth)
+    {
+        if (depth == 1)
+        {
+            // Ensure section has at least one part
+            if (parts.empty())
+                parts.push_back(std::make_shared<TabPart>("Part 1", doc.numStrings, 16));
+
+            doc.sections.push_back(std::make_shared<TabSection>(sectionName, std::move(parts)));
+            parts.clear();
+        }
+        else if (depth == 2)
+        {
+            part = nullptr;
+        }
+        else if (depth == 3)
+        {
+            columnIndex = -1;
+        }
+    };
+
+    for (;;)
+    {
+        auto token = reader.next();
+
+        if (progress != nullptr && --tagsUntilProgress < 0)
+        {
+            // The stream is a buffer ahead of the reader, which is near enough
+            if (!progress(totalLength > 0 ? (double)input.getPosition() / (double)totalLength : 0.0))
+                return nullptr;
+
+            tagsUntilProgress = 4096;
+        }
+
+        if (token == Token::startTag)
+        {
+            const auto& tag = reader.getName();
+            auto depth = open.size();
+            bool known = false;
+
+            // Sections, parts, columns and notes only count as direct
+            // children of the element above them, like in loadFromXML
+            if (depth == 1 && tag == "Section")
+            {
+                sectionName = reader.getStringAttribute("name", "Untitled");
+                known = true;
+            }
+            else if (depth == 2 && open[1].known && tag == "Part")
+            {
+                int numCols = juce::jmax(0, reader.getIntAttribute("numColumns", 16));
+                parts.push_back(std::make_shared<TabPart>(reader.getStringAttribute("name", "Part 1"), doc.numStrings, numCols));
+                part = parts.back().get();
+                known = true;
+            }
+            else if (depth == 3 && part != nullptr && tag == "Column")
+            {
+                int colIndex = reader.getIntAttribute("index");
+
+                if (colIndex >= 0 && colIndex < part->getNumColumns())
+                {
+                    part->setBarLine(colIndex, reader.getBoolAttribute("isBarLine", false));
+                    columnIndex = colIndex;
+                }
+
+                known = true;
+            }
+            else if (depth == 4 && columnIndex >= 0 && tag == "Note")
+            {
+                int str = reader.getIntAttribute("string");
+                auto column = part->getColumn(columnIndex);
+                column.setFret(str, reader.getIntAttribute("fret"));
+                column.setTechnique(str, (Technique)reader.getIntAttribute("technique", (int)Technique::None));
+            }
+
+            if (!reader.isEmptyElement())
+                open.push_back({ tag, known });
+            else if (known)
+                closeElement(depth);
+        }
+        else if (token == Token::endTag)
+        {
+            if (reader.getName() != open.back().name)
+                return nullptr;
+
+            bool known = open.back().known;
+            open.pop_back();
+
+            if (open.empty())
+                return loaded;
+
+            if (known)
+                closeElement(open.size());
+        }
+        else
+        {
+            // Either malformed or the file ended before TabData was closed
+            return nullptr;
+        }
+    }
+}
+
+bool TabEngine::loadFromStream(juce::InputStream& input)
+{
+    if (auto loaded = readFromStream(input))
+    {
+        loadDocument(std::move(loaded));
+        return true;
+    }
+
+    return false;
+}
+
+//==============================================================================
+// Binary state. Integers are unsigned LEB128 varints unless noted.
+//
+//   "TABS", version byte
+//   numStrings, rootNote, tuningType, currentSection, currentPart
+//   tuning: string count, then one pitch byte per string
+//   total column chunks, so loading can size its arena up front
+//   section count
+//
+// Version 1, the first plugin state format, then has each section's length
+// in bytes followed by its contents. Version 2 is the .tabsaver file
+// container: a table with a fixed 12-byte entry per section (offset from the
+// start of the file, length and column chunk count, each a little-endian
+// uint32), followed by the sections, so any one of them can be found without
+// reading the rest.
+//
+// A section's bytes depend on nothing outside its own node. They start with
+// the section's string table (count, then per name its UTF-8 length and
+// bytes), then its name index, part count and parts. Each part is its name
+// index and column count, then its columns.
+//
+// Columns are stored as their notes in column order, then a bar-line bitmap
+// of (numColumns + 7) / 8 bytes. A note is a varint key (columns since the
+// previous note << 5 | hasFlags << 4 | string) followed by a fret byte and,
+// if hasFlags, a flags byte. A key with string 15 ends the notes.
+//
+// Version 3 is plugin state that stores repeated material once. Parts are
+// cut into windows of 64 columns, and the header's chunk count is that of
+// the distinct windows. After the header come:
+//
+//   the document's string table
+//   window count, then per window its column count (1 to 64) and columns
+//   part count, then per distinct part its name index, column count and
+//   the index of each of its windows
+//   per section, 0 then its name index, part count and part indices, or 1
+//   then the length and bytes of a section in the layout above (one opened
+//   lazily from a file and never decoded)
+//
+// Compressed state starts with "TABZ" instead, then a codec byte (1 = zlib),
+// the uncompressed size and the zlib stream of a complete blob in one of the
+// versions above.
+namespace BinaryState
+{
+    constexpr char magic[4] = { 'T', 'A', 'B', 'S' };
+    constexpr char compressedMagic[4] = { 'T', 'A', 'B', 'Z' };
+    constexpr juce::uint8 zlibCodec = 1;
+    constexpr size_t maxDeflateRatio = 1032; // The most deflate can shrink anything by
+    constexpr juce::uint8 sectionsVersion = 1;
+    constexpr juce::uint8 containerVersion = 2;
+    constexpr juce::uint8 stateVersion = 3;
+    constexpr size_t tableEntryBytes = 12;
+    constexpr juce::uint32 stringMask = 15;
+    constexpr juce::uint32 endOfNotes = stringMask; // Not a valid string
+    constexpr juce::uint32 hasFlagsBit = 16;
+    constexpr int columnShift = 5;
+
+    struct Writer
+    {
+        juce::OutputStream& out;
+
+        void writeVarint(juce::uint32 value)
+        {
+            juce::uint8 bytes[5];
+            int n = 0;
+
+            while (value >= 0x80)
+            {
+                bytes[n++] = (juce::uint8)(value | 0x80);
+                value >>= 7;
+            }
+
+            bytes[n++] = (juce::uint8)value;
+            out.write(bytes, (size_t)n);
+        }
+
+        void writeByte(int value) { out.writeByte((char)value); }
+
+        void writeUint32(juce::uint32 value)
+        {
+            const juce::uint8 bytes[] = { (juce::uint8)value, (juce::uint8)(value >> 8), (juce::uint8)(value >> 16), (juce::uint8)(value >> 24) };
+            out.write(bytes, sizeof(bytes));
+        }
+    };
+
+    // Reads from a bounded buffer. Running off the end or reading a value
+    // that doesn't fit sets failed and returns zeros from then on, so the
+    // caller only has to check once it's done.
+    struct Reader
+    {
+        const juce::uint8* pos;
+        const juce::uint8* end;
+        bool failed = false;
+
+        size_t getRemaining() const { return (size_t)(end - pos); }
+
+        juce::uint32 readVarint()
+        {
+            juce::uint32 value = 0;
+
+            for (int shift = 0; shift < 35 && pos < end; shift += 7)
+            {
+                auto byte = *pos++;
+                value |= (juce::uint32)(byte & 0x7f) << shift;
+
+                if ((byte & 0x80) == 0)
+                    return value;
+            }
+
+            failed = true;
+            pos = end;
+            return 0;
+        }
+
+        // A varint that must lie in [0, limit]
+        int readInt(juce::uint32 limit)
+        {
+            auto value = readVarint();
+
+            if (value > limit)
+            {
+                failed = true;
+                pos = end;
+                return 0;
+            }
+
+            return (int)value;
+        }
+
+        int readByte()
+        {
+            if (pos < end)
+                return *pos++;
+
+            failed = true;
+            return 0;
+        }
+
+        juce::uint32 readUint32()
+        {
+            if (auto* bytes = readBytes(4))
+                return (juce::uint32)bytes[0] | (juce::uint32)bytes[1] << 8 | (juce::uint32)bytes[2] << 16 | (juce::uint32)bytes[3] << 24;
+
+            return 0;
+        }
+
+        // An index into a list of count items
+        int readIndex(size_t count)
+        {
+            if (count == 0)
+            {
+                failed = true;
+                pos = end;
+                return 0;
+            }
+
+            return readInt((juce::uint32)juce::jmin(count - 1, (size_t)std::numeric_limits<int>::max()));
+        }
+
+        const juce::uint8* readBytes(size_t n)
+        {
+            if (n > getRemaining())
+            {
+                failed = true;
+                pos = end;
+                return nullptr;
+            }
+
+            auto* start = pos;
+            pos += n;
+            return start;
+        }
+    };
+}
+
+static void writeHeader(BinaryState::Writer& writer, const TabDocument& doc, juce::uint8 version, size_t numChunks)
+{
+    writer.out.write(BinaryState::magic, sizeof(BinaryState::magic));
+    writer.writeByte(version);
+
+    writer.writeVarint((juce::uint32)doc.numStrings);
+    writer.writeVarint((juce::uint32)doc.rootNote);
+    writer.writeVarint((juce::uint32)doc.tuningType);
+    writer.writeVarint((juce::uint32)juce::jmax(0, doc.currentSectionIndex));
+    writer.writeVarint((juce::uint32)juce::jmax(0, doc.currentPartIndex));
+
+    writer.writeVarint((juce::uint32)doc.tuning.getNumStrings());
+    for (int i = 0; i < doc.tuning.getNumStrings(); ++i)
+        writer.writeByte(doc.tuning.getPitch(i));
+
+    writer.writeVarint((juce::uint32)numChunks);
+    writer.writeVarint((juce::uint32)doc.getNumSections());
+}
+
+static void writeStringTable(BinaryState::Writer& writer, const std::vector<const juce::String*>& names)
+{
+    writer.writeVarint((juce::uint32)names.size());
+
+    for (const auto* name : names)
+    {
+        auto numBytes = name->getNumBytesAsUTF8();
+        writer.writeVarint((juce::uint32)numBytes);
+        writer.out.write(name->toRawUTF8(), numBytes);
+    }
+}
+
+static juce::StringArray readStringTable(BinaryState::Reader& reader)
+{
+    juce::StringArray names;
+    int numNames = reader.readInt((juce::uint32)reader.getRemaining());
+    names.ensureStorageAllocated(numNames);
+
+    for (int i = 0; i < numNames; ++i)
+    {
+        auto numBytes = (size_t)reader.readInt((juce::uint32)reader.getRemaining());
+        auto* bytes = reader.readBytes(numBytes);
+        names.add(bytes != nullptr ? juce::String::fromUTF8(reinterpret_cast<const char*>(bytes), (int)numBytes) : juce::String());
+    }
+
+    return names;
+}
+
+// Columns [start, end) as notes, then a bar-line bitmap
+static void writeColumns(BinaryState::Writer& writer, const TabColumnSequence& columns, int start, int end)
+{
+    std::vector<juce::uint8> barLines((size_t)(end - start + 7) / 8, 0);
+    int previousColumn = start;
+
+    columns.forEachColumn(start, end, [&](ConstTabColumn column, int index)
+    {
+        if (columns.isBarLine(index))
+            barLines[(size_t)(index - start) / 8] |= (juce::uint8)(1 << ((index - start) % 8));
+
+        for (int str = 0; str < column.getNumStrings(); ++str)
+        {
+            const auto& cell = column[str];
+            if (cell.isEmpty())
+                continue;
+
+            auto key = (juce::uint32)(index - previousColumn) << BinaryState::columnShift | (juce::uint32)str;
+            if (cell.flags != 0)
+                key |= BinaryState::hasFlagsBit;
+
+            writer.writeVarint(key);
+            writer.writeByte(cell.fret);
+            if (cell.flags != 0)
+                writer.writeByte(cell.flags);
+
+            previousColumn = index;
+        }
+    });
+
+    writer.writeVarint(BinaryState::endOfNotes);
+    writer.out.write(barLines.data(), barLines.size());
+}
+
+// Fills in every column of the sequence from what writeColumns wrote
+static void readColumns(BinaryState::Reader& reader, TabColumnSequence& columns)
+{
+    int numCols = columns.size();
+    int numStrings = columns.getNumStrings();
+
+    // Notes come in column order, so they're filled in with one walk over
+    // the chunks
+    auto key = reader.readVarint();
+    int nextColumn = (int)juce::jmin(key >> BinaryState::columnShift, (juce::uint32)numCols);
+
+    columns.forEachColumn(0, numCols, [&](TabColumn column, int index)
+    {
+        while (nextColumn == index && (key & BinaryState::stringMask) != BinaryState::endOfNotes && !reader.failed)
+        {
+            int str = (int)(key & BinaryState::stringMask);
+            TabCell cell;
+            cell.fret = (juce::int8)juce::jmin(127, reader.readByte());
+            cell.flags = (key & BinaryState::hasFlagsBit) != 0 ? (juce::uint8)reader.readByte() : 0;
+
+            if (str < numStrings)
+                column[str] = cell;
+            else
+                reader.failed = true;
+
+            key = reader.readVarint();
+            nextColumn = index + (int)juce::jmin(key >> BinaryState::columnShift, (juce::uint32)numCols);
+        }
+    });
+
+    // Anything but the end marker here is a note past the last column
+    if ((key & BinaryState::stringMask) != BinaryState::endOfNotes)
+        reader.failed = true;
+
+    if (auto* bits = reader.readBytes((size_t)(numCols + 7) / 8))
+        for (int col = 0; col < numCols; ++col)
+            if ((bits[col / 8] >> (col % 8)) & 1)
+                columns.setBarLine(col, true);
+}
+
+// The section's own name, which comes first in its string table
+static juce::String peekSectionName(const juce::uint8* data, size_t sizeInBytes)
+{
+    BinaryState::Reader reader { data, data + sizeInBytes };
+
+    if (reader.readVarint() == 0)
+        return {};
+
+    auto numBytes = (size_t)reader.readInt((juce::uint32)reader.getRemaining());
+    auto* bytes = reader.readBytes(numBytes);
+    return bytes != nullptr ? juce::String::fromUTF8(reinterpret_cast<const char*>(bytes), (int)numBytes) : juce::String();
+}
+
+// The bytes a section is saved as without encoding it: those of a section
+// that was never decoded, or of one that couldn't be and still stands as the
+// empty section it was replaced with. Once that's edited (or renamed), its
+// parts are what's saved; undoing the edit brings the bytes back.
+static const TabSection::Encoded* getSavedBytes(const TabSection& section)
+{
+    if (!section.isDecoded())
+        return &section.encoded;
+
+    const auto& bytes = section.unreadable;
+
+    if (bytes.data == nullptr || section.parts.size() != 1 || section.name != peekSectionName(bytes.data, bytes.size))
+        return nullptr;
+
+    const auto& part = *section.parts.front();
+
+    if (part.name != "Part 1" || part.getNumColumns() != 16)
+        return nullptr;
+
+    bool isEmpty = true;
+    part.columns.forEachColumn(0, part.getNumColumns(), [&](ConstTabColumn column, int index)
+    {
+        isEmpty = isEmpty && !part.isBarLine(index);
+
+        for (int i = 0; i < column.getNumStrings(); ++i)
+            isEmpty = isEmpty && column[i] == TabCell();
+    });
+
+    return isEmpty ? &bytes : nullptr;
+}
+
+// Stands in for a section whose bytes couldn't be decoded. It keeps its own
+// copy of them, which outlives whatever held them, such as the mapping of a
+// file that's about to be saved over.
+static std::shared_ptr<TabSection> makeUnreadableSection(const juce::String& name, const TabSection::Encoded& bytes, int numStrings)
+{
+    auto copy = std::make_shared<juce::MemoryBlock>(bytes.data, bytes.size);
+
+    auto section = std::make_shared<TabSection>(name, numStrings, 16);
+    section->unreadable = { copy, static_cast<const juce::uint8*>(copy->getData()), bytes.size, bytes.numChunks };
+    return section;
+}
+
+static void encodeSection(const TabSection& section, juce::MemoryBlock& destData)
+{
+    // A section that was never decoded (or couldn't be) is still in this format
+    if (auto* bytes = getSavedBytes(section))
+    {
+        destData.replaceAll(bytes->data, bytes->size);
+        return;
+    }
+
+    juce::MemoryOutputStream out(destData, false);
+    BinaryState::Writer writer { out };
+
+    // Names repeat a lot ("Part 1", "Lead"...), so each is stored once
+    std::map<juce::String, int> nameIndices;
+    std::vector<const juce::String*> names;
+
+    auto addName = [&](const juce::String& name)
+    {
+        if (nameIndices.emplace(name, (int)names.size()).second)
+            names.push_back(&name);
+    };
+
+    addName(section.name);
+    for (const auto& part : section.parts)
+        addName(part->name);
+
+    writeStringTable(writer, names);
+
+    writer.writeVarint((juce::uint32)nameIndices[section.name]);
+    writer.writeVarint((juce::uint32)section.getNumParts());
+
+    for (const auto& part : section.parts)
+    {
+        writer.writeVarint((juce::uint32)nameIndices[part->name]);
+        writer.writeVarint((juce::uint32)part->getNumColumns());
+        writeColumns(writer, part->columns, 0, part->getNumColumns());
+    }
+}
+
+// A part's columns, a window of chunkCapacity columns at a time, each
+// preceded by its column count
+static void encodeWindows(const TabPart& part, juce::MemoryBlock& destData, std::vector<size_t>& windowEnds)
+{
+    juce::MemoryOutputStream out(destData, false);
+    BinaryState::Writer writer { out };
+
+    for (int start = 0; start < part.getNumColumns(); start += TabColumnSequence::chunkCapacity)
+    {
+        int end = juce::jmin(part.getNumColumns(), start + TabColumnSequence::chunkCapacity);
+        writer.writeVarint((juce::uint32)(end - start));
+        writeColumns(writer, part.columns, start, end);
+        windowEnds.push_back((size_t)out.getPosition());
+    }
+}
+
+static void compressState(const juce::MemoryBlock& state, juce::MemoryBlock& destData, TabEngine::StateCompression compression)
+{
+    juce::MemoryOutputStream out(destData, false);
+    BinaryState::Writer writer { out };
+
+    out.write(BinaryState::compressedMagic, sizeof(BinaryState::compressedMagic));
+    writer.writeByte(BinaryState::zlibCodec);
+    writer.writeVarint((juce::uint32)state.getSize());
+
+    juce::GZIPCompressorOutputStream zipper(out, compression == TabEngine::StateCompression::fast ? 1 : 9);
+    zipper.write(state.getData(), state.getSize());
+    zipper.flush();
+}
+
+// Returns false if the bytes aren't a complete compressed blob holding
+// uncompressed state
+static bool decompressState(const juce::uint8* data, size_t sizeInBytes, juce::MemoryBlock& destData)
+{
+    BinaryState::Reader reader { data + sizeof(BinaryState::compressedMagic), data + sizeInBytes };
+
+    if (reader.readByte() != BinaryState::zlibCodec)
+        return false;
+
+    auto limit = juce::jmin(reader.getRemaining() * BinaryState::maxDeflateRatio, (size_t)std::numeric_limits<int>::max());
+    auto size = (size_t)reader.readInt((juce::uint32)juce::jmin(limit, (size_t)std::numeric_limits<juce::uint32>::max()));
+
+    if (reader.failed || size <= sizeof(BinaryState::magic))
+        return false;
+
+    juce::MemoryInputStream compressed(reader.pos, reader.getRemaining(), false);
+    juce::GZIPDecompressorInputStream unzipper(compressed);
+
+    // The declared size is only a claim, so the state is inflated a block at
+    // a time and the block grows with what actually comes out. A damaged size
+    // then costs no more memory than the stream really holds, and a stream
+    // that ends early or runs past the size is rejected.
+    constexpr int inflateBlockSize = 64 * 1024;
+    juce::HeapBlock<char> buffer(inflateBlockSize);
+    size_t numInflated = 0;
+
+    {
+        juce::MemoryOutputStream out(destData, false);
+        out.preallocate(juce::jmin(size, (size_t)inflateBlockSize * 16));
+
+        for (;;)
+        {
+            // Asking for one byte more than is left shows up a stream that's too long
+            auto numRead = unzipper.read(buffer, (int)juce::jmin((size_t)inflateBlockSize, size - numInflated + 1));
+
+            if (numRead <= 0)
+                break;
+
+            numInflated += (size_t)numRead;
+
+            if (numInflated > size)
+                return false;
+
+            out.write(buffer, (size_t)numRead);
+        }
+    }
+
+    return numInflated == size
+        && std::memcmp(destData.getData(), BinaryState::magic, sizeof(BinaryState::magic)) == 0;
+}
+
+void TabEngine::saveToBinary(juce::MemoryBlock& destData, StateCompression compression) const
+{
+    if (compression != StateCompression::none)
+    {
+        juce::MemoryBlock state;
+        saveToBinary(state);
+        compressState(state, destData, compression);
+        return;
+    }
+
+    auto snapshot = getSnapshot();
+
+    const juce::ScopedLock lock(encodedPartsLock);
+
+    // A part node is replaced whenever anything in it changes, so a node
+    // that's still in the cache hasn't changed since it was encoded. Only new
+    // nodes get encoded; the rest is copied.
+    PartEncodings encoded;
+
+    writeState(*snapshot, destData, [&](const std::shared_ptr<TabPart>& part) -> const EncodedPart&
+    {
+        auto& entry = encoded[part.get()];
+
+        if (entry.part == nullptr)
+        {
+            auto cached = encodedParts.find(part.get());
+
+            if (cached != encodedParts.end())
+            {
+                entry = std::move(cached->second);
+            }
+            else
+            {
+                entry.part = part;
+                encodeWindows(*part, entry.bytes, entry.windowEnds);
+            }
+        }
+
+        return entry;
+    });
+
+    encodedParts = std::move(encoded);
+}
+
+void TabEngine::saveToBinary(const TabDocument& doc, juce::MemoryBlock& destData, StateCompression compression)
+{
+    if (compression != StateCompression::none)
+    {
+        juce::MemoryBlock state;
+        saveToBinary(doc, state);
+        compressState(state, destData, compression);
+        return;
+    }
+
+    PartEncodings encoded;
+
+    writeState(doc, destData, [&](const std::shared_ptr<TabPart>& part) -> const EncodedPart&
+    {
+        auto& entry = encoded[part.get()];
+
+        if (entry.part == nullptr)
+        {
+            entry.part = part;
+            encodeWindows(*part, entry.bytes, entry.windowEnds);
+        }
+
+        return entry;
+    });
+}
+
+void TabEngine::writeState(const TabDocument& doc, juce::MemoryBlock& destData,
+                           const std::function<const EncodedPart& (const std::shared_ptr<TabPart>&)>& encodingOf)
+{
+    std::map<juce::String, int> nameIndices;
+    std::vector<const juce::String*> names;
+
+    auto nameIndex = [&](const juce::String& name)
+    {
+        auto added = nameIndices.emplace(name, (int)names.size());
+        if (added.second)
+            names.push_back(&name);
+
+        return (juce::uint32)added.first->second;
+    };
+
+    // Windows and parts are looked up by their bytes, so identical content
+    // is written once however many nodes hold it
+    std::unordered_map<std::string_view, int> windowIndices;
+    std::vector<std::string_view> windows;
+
+    std::unordered_map<std::string, int> partIndices;
+    juce::MemoryOutputStream parts, sections, partRecord;
+    BinaryState::Writer partWriter { partRecord }, sectionWriter { sections };
+    size_t numChunks = 0;
+
+    for (const auto& section : doc.sections)
+    {
+        if (auto* bytes = getSavedBytes(*section))
+        {
+            sectionWriter.writeVarint(1);
+            sectionWriter.writeVarint((juce::uint32)bytes->size);
+            sections.write(bytes->data, bytes->size);
+            numChunks += bytes->numChunks;
+            continue;
+        }
+
+        sectionWriter.writeVarint(0);
+        sectionWriter.writeVarint(nameIndex(section->name));
+        sectionWriter.writeVarint((juce::uint32)section->getNumParts());
+
+        for (const auto& part : section->parts)
+        {
+            const auto& encoding = encodingOf(part);
+            auto* bytes = static_cast<const char*>(encoding.bytes.getData());
+
+            partRecord.reset();
+            partWriter.writeVarint(nameIndex(part->name));
+            partWriter.writeVarint((juce::uint32)part->getNumColumns());
+
+            for (size_t w = 0, start = 0; w < encoding.windowEnds.size(); start = encoding.windowEnds[w++])
+            {
+                std::string_view window(bytes + start, encoding.windowEnds[w] - start);
+                auto added = windowIndices.emplace(window, (int)windows.size());
+
+                if (added.second)
+                    windows.push_back(window);
+
+                partWriter.writeVarint((juce::uint32)added.first->second);
+            }
+
+            auto added = partIndices.emplace(std::string(static_cast<const char*>(partRecord.getData()), partRecord.getDataSize()),
+                                             (int)partIndices.size());
+
+            if (added.second)
+                parts.write(partRecord.getData(), partRecord.getDataSize());
+
+            sectionWriter.writeVarint((juce::uint32)added.first->second);
+        }
+    }
+
+    numChunks += windows.size();
+
+    juce::MemoryOutputStream out(destData, false);
+    BinaryState::Writer writer { out };
+    writeHeader(writer, doc, BinaryState::stateVersion, numChunks);
+    writeStringTable(writer, names);
+
+    writer.writeVarint((juce::uint32)windows.size());
+    for (const auto& window : windows)
+        out.write(window.data(), window.size());
+
+    writer.writeVarint((juce::uint32)partIndices.size());
+    out.write(parts.getData(), parts.getDataSize());
+    out.write(sections.getData(), sections.getDataSize());
+}
+
+// Returns nullptr if the bytes aren't exactly one valid section
+static std::shared_ptr<TabSection> decodeSection(const juce::uint8* data, size_t sizeInBytes, int numStrings,
+                                                 TabColumnSequence::ChunkArena& arena)
+{
+    BinaryState::Reader reader { data, data + sizeInBytes };
+
+    auto names = readStringTable(reader);
+    auto readName = [&] { return names[reader.readInt((juce::uint32)juce::jmax(0, names.size() - 1))]; };
+
+    auto sectionName = readName();
+    int numParts = reader.readInt((juce::uint32)reader.getRemaining());
+
+    std::vector<std::shared_ptr<TabPart>> parts;
+    parts.reserve((size_t)numParts);
+
+    for (int p = 0; p < numParts && !reader.failed; ++p)
+    {
+        auto partName = readName();
+        int numCols = reader.readInt((juce::uint32)juce::jmin(reader.getRemaining() * 8, (size_t)std::numeric_limits<int>::max()));
+
+        parts.push_back(std::make_shared<TabPart>(partName, TabColumnSequence(numStrings, numCols, arena)));
+        readColumns(reader, parts.back()->columns);
+    }
+
+    if (reader.failed || reader.getRemaining() != 0)
+        return nullptr;
+
+    if (parts.empty())
+        parts.push_back(std::make_shared<TabPart>("Part 1", numStrings, 16));
+
+    return std::make_shared<TabSection>(sectionName, std::move(parts));
+}
+
+// Everything in a version 3 state after its header. Parts are built by
+// appending shared windows and sections by sharing parts, so whatever the
+// saved document repeated is stored once again. Returns false unless the
+// bytes hold exactly numSections valid sections.
+static bool decodeSharedSections(BinaryState::Reader& reader, TabDocument& doc, int numSections,
+                                 TabColumnSequence::ChunkArena& arena)
+{
+    auto names = readStringTable(reader);
+    auto readName = [&] { return names[reader.readInt((juce::uint32)juce::jmax(0, names.size() - 1))]; };
+
+    // Every window, part and section takes at least a byte
+    std::vector<TabColumnSequence> windows((size_t)reader.readInt((juce::uint32)reader.getRemaining()));
+
+    for (auto& window : windows)
+    {
+        int numCols = reader.readInt(TabColumnSequence::chunkCapacity);
+        if (numCols == 0 || reader.failed)
+            return false;
+
+        window = TabColumnSequence(doc.numStrings, numCols, arena);
+        readColumns(reader, window);
+    }
+
+    std::vector<std::shared_ptr<TabPart>> parts((size_t)reader.readInt((juce::uint32)reader.getRemaining()));
+
+    for (auto& part : parts)
+    {
+        auto partName = readName();
+        int numCols = reader.readInt((juce::uint32)juce::jmin(reader.getRemaining() * TabColumnSequence::chunkCapacity,
+                                                              (size_t)std::numeric_limits<int>::max()));
+
+        TabColumnSequence columns(doc.numStrings, 0);
+
+        for (int start = 0; start < numCols && !reader.failed; start += TabColumnSequence::chunkCapacity)
+        {
+            // An empty table fails the read rather than giving an index
+            auto index = (size_t)reader.readIndex(windows.size());
+
+            if (reader.failed)
+                return false;
+
+            const auto& window = windows[index];
+
+            if (window.size() != juce::jmin(TabColumnSequence::chunkCapacity, numCols - start))
+                return false;
+
+            columns.append(window);
+        }
+
+        part = std::make_shared<TabPart>(partName, std::move(columns));
+    }
+
+    for (int s = 0; s < numSections && !reader.failed; ++s)
+    {
+        if (reader.readInt(1) == 0)
+        {
+            auto sectionName = readName();
+            std::vector<std::shared_ptr<TabPart>> sectionParts((size_t)reader.readInt((juce::uint32)reader.getRemaining()));
+
+            for (auto& part : sectionParts)
+            {
+                auto index = (size_t)reader.readIndex(parts.size());
+
+                if (reader.failed)
+                    return false;
+
+                part = parts[index];
+            }
+
+            if (sectionParts.empty())
+                sectionParts.push_back(std::make_shared<TabPart>("Part 1", doc.numStrings, 16));
+
+            doc.sections.push_back(std::make_shared<TabSection>(sectionName, std::move(sectionParts)));
+        }
+        else
+        {
+            auto sectionBytes = (size_t)reader.readInt((juce::uint32)reader.getRemaining());
+            auto* sectionData = reader.readBytes(sectionBytes);
+
+            if (sectionData == nullptr)
+                return false;
+
+            // Bytes saved as they were, which may be those of a section that
+            // couldn't be read before either
+            auto section = decodeSection(sectionData, sectionBytes, doc.numStrings, arena);
+
+            if (section == nullptr)
+                section = makeUnreadableSection(peekSectionName(sectionData, sectionBytes),
+                                              { nullptr, sectionData, sectionBytes, 0 }, doc.numStrings);
+
+            doc.sections.push_back(std::move(section));
+        }
+    }
+
+    return !reader.failed && reader.getRemaining() == 0;
+}
+
+bool TabEngine::isBinaryState(const void* data, size_t sizeInBytes)
+{
+    return sizeInBytes > sizeof(BinaryState::magic)
+        && (std::memcmp(data, BinaryState::magic, sizeof(BinaryState::magic)) == 0
+             || std::memcmp(data, BinaryState::compressedMagic, sizeof(BinaryState::compressedMagic)) == 0);
+}
+
+bool TabEngine::loadFromBinary(const void* data, size_t sizeInBytes)
+{
+    if (auto loaded = readBinary(static_cast<const juce::uint8*>(data), sizeInBytes, nullptr))
+    {
+        loadDocument(std::move(loaded));
+        return true;
+    }
+
+    return false;
+}
+
+std::shared_ptr<TabDocument> TabEngine::readBinary(const juce::uint8* data, size_t sizeInBytes, std::shared_ptr<const void> owner,
+                                                   const ProgressCallback& progress)
+{
+    if (!isBinaryState(data, sizeInBytes))
+        return nullptr;
+
+    // Inflated state lives only as long as this call, so it's all decoded now
+    if (std::memcmp(data, BinaryState::compressedMagic, sizeof(BinaryState::compressedMagic)) == 0)
+    {
+        juce::MemoryBlock state;
+
+        if (!decompressState(data, sizeInBytes, state))
+            return nullptr;
+
+        return readBinary(static_cast<const juce::uint8*>(state.getData()), state.getSize(), nullptr, progress);
+    }
+
+    BinaryState::Reader reader { data + sizeof(BinaryState::magic), data + sizeInBytes };
+
+    auto version = reader.readByte();
+    if (version != BinaryState::sectionsVersion && version != BinaryState::containerVersion && version != BinaryState::stateVersion)
+        return nullptr;
+
+    // Build the new document off to the side and swap it in at the end
+    auto loaded = std::make_shared<TabDocument>();
+    auto& doc = *loaded;
+
+    doc.numStrings = juce::jmax(1, reader.readInt(TabColumnSequence::maxStrings));
+    doc.rootNote = reader.readInt(11);
+    doc.tuningType = (TuningType)reader.readInt((juce::uint32)TuningType::Custom);
+    doc.currentSectionIndex = reader.readInt((juce::uint32)std::numeric_limits<int>::max());
+    doc.currentPartIndex = reader.readInt((juce::uint32)std::numeric_limits<int>::max());
+
+    doc.tuning = GuitarTuning();
+    doc.tuning.numStrings = reader.readInt(GuitarTuning::maxStrings);
+    for (int i = 0; i < doc.tuning.getNumStrings(); ++i)
+        doc.tuning.setPitch(i, juce::jmin(127, reader.readByte()));
+
+    if (doc.tuning.getNumStrings() != doc.numStrings)
+        doc.tuning.resize(doc.numStrings);
+
+    // Every count is checked against the bytes left, so a damaged blob can't
+    // ask for more memory than its own size justifies. The chunk count only
+    // sizes the arena, which caps it again.
+    auto numChunks = (size_t)reader.readInt((juce::uint32)reader.getRemaining());
+
+    int numSections = reader.readInt((juce::uint32)reader.getRemaining());
+    doc.sections.reserve((size_t)numSections);
+
+    if (version == BinaryState::stateVersion)
+    {
+        TabColumnSequence::ChunkArena arena(numChunks);
+
+        if (!decodeSharedSections(reader, doc, numSections, arena))
+            return nullptr;
+    }
+    else if (version == BinaryState::sectionsVersion)
+    {
+        TabColumnSequence::ChunkArena arena(numChunks);
+
+        for (int s = 0; s < numSections && !reader.failed; ++s)
+        {
+            if (progress != nullptr && !progress((double)s / numSections))
+                return nullptr;
+
+            auto sectionBytes = (size_t)reader.readInt((juce::uint32)reader.getRemaining());
+            auto* sectionData = reader.readBytes(sectionBytes);
+
+            if (sectionData == nullptr)
+                break;
+
+            auto section = decodeSection(sectionData, sectionBytes, doc.numStrings, arena);
+
+            if (section == nullptr)
+                section = makeUnreadableSection(peekSectionName(sectionData, sectionBytes), { nullptr, sectionData, sectionBytes, 0 }, doc.numStrings);
+
+            doc.sections.push_back(std::move(section));
+        }
+    }
+    else
+    {
+        auto* table = reader.readBytes((size_t)numSections * BinaryState::tableEntryBytes);
+        auto tableEnd = (size_t)(reader.pos - data);
+
+        // Without an owner to keep the bytes alive, every section is decoded now
+        std::unique_ptr<TabColumnSequence::ChunkArena> arena;
+        if (owner == nullptr)
+            arena = std::make_unique<TabColumnSequence::ChunkArena>(numChunks);
+
+        for (int s = 0; s < numSections && !reader.failed; ++s)
+        {
+            BinaryState::Reader entry { table + (size_t)s * BinaryState::tableEntryBytes, table + (size_t)(s + 1) * BinaryState::tableEntryBytes };
+            size_t offset = entry.readUint32();
+            size_t size = entry.readUint32();
+            size_t sectionChunks = entry.readUint32();
+
+            if (offset < tableEnd || offset > sizeInBytes || size > sizeInBytes - offset || sectionChunks > size)
+            {
+                reader.failed = true;
+                break;
+            }
+
+            if (owner == nullptr)
+            {
+                if (progress != nullptr && !progress((double)s / numSections))
+                    return nullptr;
+
+                auto section = decodeSection(data + offset, size, doc.numStrings, *arena);
+
+                if (section == nullptr)
+                    section = makeUnreadableSection(peekSectionName(data + offset, size), { nullptr, data + offset, size, sectionChunks }, doc.numStrings);
+
+                doc.sections.push_back(std::move(section));
+            }
+            else
+            {
+                auto section = std::make_shared<TabSection>(peekSectionName(data + offset, size), std::vector<std::shared_ptr<TabPart>>());
+                section->encoded = { owner, data + offset, size, sectionChunks };
+                doc.sections.push_back(std::move(section));
+            }
+        }
+    }
+
+    if (reader.failed)
+        return nullptr;
+
+    return loaded;
+}
+
+std::shared_ptr<TabSection> TabEngine::decoded(const std::shared_ptr<TabSection>& section, int numStrings)
+{
+    if (section->isDecoded())
+        return section;
+
+    const auto& encoded = section->encoded;
+    TabColumnSequence::ChunkArena arena(encoded.numChunks);
+
+    if (auto result = decodeSection(encoded.data, encoded.size, numStrings, arena))
+        return result;
+
+    // The file was only checked up to its section table when it was opened,
+    // so this is where damage inside a section turns up
+    return makeUnreadableSection(section->name, encoded, numStrings);
+}
+
+bool TabEngine::isSectionUnreadable(int sectionIndex) const
+{
+    if (sectionIndex < 0 || sectionIndex >= getNumSections())
+        return false;
+
+    const auto& section = document->getSection(sectionIndex);
+    return section.isDecoded() && getSavedBytes(section) != nullptr;
+}
+
+// Writes the container to the temporary file, leaving the target alone
+static bool writeTemporary(const TabDocument& doc, const juce::TemporaryFile& temp, const TabEngine::ProgressCallback& progress)
+{
+    juce::FileOutputStream stream(temp.getFile());
+
+    if (!stream.openedOk() || !TabEngine::writeContainer(doc, stream, progress))
+        return false;
+
+    stream.flush();
+    return stream.getStatus().wasOk();
+}
+
+std::shared_ptr<TabEngine::SaveJob> TabEngine::prepareSave(const juce::File& file) const
+{
+    auto job = std::make_shared<SaveJob>();
+    job->file = file;
+    job->snapshot = getSnapshot();
+
+    // Undo can bring back sections that were never decoded, so the nodes the
+    // history holds are copied too. Only the pointers are gathered here.
+    for (auto* stack : { &journal.undoStack, &journal.redoStack })
+    {
+        auto node = stack->nodes.begin();
+
+        for (const auto& record : stack->records)
+        {
+            if (!TabJournal::hasNode(record.op))
+                continue;
+
+            if (record.op == TabJournal::Op::swapSection || record.op == TabJournal::Op::removeSection)
+            {
+                auto section = std::static_pointer_cast<TabSection>(*node);
+
+                if (!section->isDecoded())
+                    job->history.push_back(std::move(section));
+            }
+            else if (record.op == TabJournal::Op::swapDocument)
+            {
+                for (const auto& section : static_cast<const TabDocument*>(node->get())->sections)
+                    if (!section->isDecoded())
+                        job->history.push_back(section);
+            }
+
+            ++node;
+        }
+    }
+
+    return job;
+}
+
+bool TabEngine::SaveJob::write(const ProgressCallback& progress)
+{
+    // Each node is copied once, however many places hold it
+    auto inMemory = [this](const std::shared_ptr<TabSection>& section)
+    {
+        if (section->isDecoded())
+            return section;
+
+        auto& copy = copies[section.get()];
+
+        if (copy == nullptr)
+        {
+            auto bytes = std::make_shared<juce::MemoryBlock>(section->encoded.data, section->encoded.size);
+
+            copy = std::make_shared<TabSection>(*section);
+            copy->encoded.owner = bytes;
+            copy->encoded.data = static_cast<const juce::uint8*>(bytes->getData());
+        }
+
+        return copy;
+    };
+
+    auto detached = std::make_shared<TabDocument>(*snapshot);
+    numUnreadable = 0;
+
+    for (auto& section : detached->sections)
+    {
+        section = inMemory(section);
+
+        if (section->isDecoded() && getSavedBytes(*section) != nullptr)
+            ++numUnreadable;
+    }
+
+    for (const auto& section : history)
+        inMemory(section);
+
+    // From here on the job only reads the copies
+    snapshot = detached;
+    history.clear();
+
+    temp = std::make_unique<juce::TemporaryFile>(file);
+    return writeTemporary(*snapshot, *temp, progress);
+}
+
+bool TabEngine::finishSave(SaveJob& job)
+{
+    if (job.temp == nullptr)
+        return false;
+
+    auto inMemory = [&job](const std::shared_ptr<TabSection>& section)
+    {
+        auto copy = job.copies.find(section.get());
+        return copy != job.copies.end() ? copy->second : section;
+    };
+
+    // Sections may have been decoded, added or undone since the snapshot,
+    // so the copies replace whichever of their nodes are still around
+    auto sections = document->sections;
+    bool anyCopied = false;
+
+    for (auto& section : sections)
+    {
+        auto copy = inMemory(section);
+        anyCopied = anyCopied || copy != section;
+        section = std::move(copy);
+    }
+
+    if (anyCopied)
+    {
+        // Copying changes nothing a listener or the journal could see
+        const juce::SpinLock::ScopedLockType lock(documentLock);
+        editDocument().sections = std::move(sections);
+    }
+
+    for (auto* stack : { &journal.undoStack, &journal.redoStack })
+    {
+        auto node = stack->nodes.begin();
+
+        for (const auto& record : stack->records)
+        {
+            if (!TabJournal::hasNode(record.op))
+                continue;
+
+            if (record.op == TabJournal::Op::swapSection || record.op == TabJournal::Op::removeSection)
+            {
+                *node = inMemory(std::static_pointer_cast<TabSection>(*node));
+            }
+            else if (record.op == TabJournal::Op::swapDocument)
+            {
+                const auto& doc = *static_cast<const TabDocument*>(node->get());
+
+                if (std::any_of(doc.sections.begin(), doc.sections.end(), [&](const auto& s) { return inMemory(s) != s; }))
+                {
+                    auto copy = std::make_shared<TabDocument>(doc);
+
+                    for (auto& section : copy->sections)
+                        section = inMemory(section);
+
+                    *node = std::move(copy);
+                }
+            }
+
+            ++node;
+        }
+    }
+
+    {
+        // Text export keeps the sections it decoded under their encoded
+        // nodes, which move to the copies so its renderings still match
+        const juce::ScopedLock lock(renderedTextLock);
+        SectionDecodings moved;
+
+        for (auto& [key, entry] : renderedText.sections)
+        {
+            auto copy = job.copies.find(key);
+
+            if (copy == job.copies.end())
+            {
+                moved[key] = std::move(entry);
+                continue;
+            }
+
+            entry.encoded = copy->second;
+            moved[copy->second.get()] = std::move(entry);
+        }
+
+        renderedText.sections = std::move(moved);
     }
+
+    job.snapshot = nullptr;
+    job.copies.clear();
+
+    auto replaced = job.temp->overwriteTargetFileWithTemporary();
+    job.temp = nullptr;
+    return replaced;
 }
 
-bool TabEngine::isColumnBarLine(int index) const
+std::shared_ptr<TabPart> TabEngine::withNumStrings(const std::shared_ptr<TabPart>& part, int numStrings)
 {
-    auto* part = getCurrentPartPtr();
-    if (!part) return false;
+    if (part->getNumStrings() == numStrings)
+        return part;
+
+    TabColumnSequence::ChunkArena arena(part->columns.getNumChunks());
+    int stringsToCopy = juce::jmin(part->getNumStrings(), numStrings);
+
+    return std::make_shared<TabPart>(part->name, part->columns.withNumStrings(numStrings, arena,
+        [stringsToCopy](ConstTabColumn oldColumn, TabColumn newColumn)
+        {
+            for (int i = 0; i < stringsToCopy; ++i)
+                newColumn[i] = oldColumn[i];
+        }));
+}
+
+void TabEngine::decodeCurrentSection()
+{
+    int index = document->currentSectionIndex;
+
+    if (index < 0 || index >= getNumSections() || document->sections[(size_t)index]->isDecoded())
+        return;
+
+    // Decoding changes nothing a listener or the journal could see, so the
+    // new node just replaces the encoded one
+    auto section = decoded(document->sections[(size_t)index], document->numStrings);
+
+    const juce::SpinLock::ScopedLockType lock(documentLock);
+    editDocument().sections[(size_t)index] = std::move(section);
+}
+
+bool TabEngine::writeContainer(const TabDocument& doc, juce::OutputStream& output, const ProgressCallback& progress)
+{
+    // Encoding is most of the work, so that is what progress is counted in
+    std::vector<juce::MemoryBlock> sections((size_t)doc.getNumSections());
+    for (size_t i = 0; i < sections.size(); ++i)
+    {
+        if (progress != nullptr && !progress((double)i / (double)sections.size()))
+            return false;
+
+        encodeSection(*doc.sections[i], sections[i]);
+    }
+
+    size_t numChunks = 0;
+    for (const auto& section : doc.sections)
+        numChunks += countChunks(*section);
+
+    juce::MemoryOutputStream header;
+    BinaryState::Writer headerWriter { header };
+    writeHeader(headerWriter, doc, BinaryState::containerVersion, numChunks);
+
+    BinaryState::Writer writer { output };
+    output.write(header.getData(), header.getDataSize());
+
+    auto offset = header.getDataSize() + sections.size() * BinaryState::tableEntryBytes;
+
+    for (size_t i = 0; i < sections.size(); ++i)
+    {
+        writer.writeUint32((juce::uint32)offset);
+        writer.writeUint32((juce::uint32)sections[i].getSize());
+        writer.writeUint32((juce::uint32)countChunks(*doc.sections[i]));
+        offset += sections[i].getSize();
+    }
+
+    for (const auto& section : sections)
+        output.write(section.getData(), section.getSize());
+
+    return true;
+}
+
+bool TabEngine::saveToFile(const juce::File& file)
+{
+    auto job = prepareSave(file);
+    return job->write() && finishSave(*job);
+}
+
+bool TabEngine::writeFile(const TabDocument& doc, const juce::File& file, const ProgressCallback& progress)
+{
+    // Renaming also leaves the old file's contents in place for any
+    // sections that are still being read from a mapping of it, on systems
+    // that allow a mapped file to be replaced at all
+    juce::TemporaryFile temp(file);
+    return writeTemporary(doc, temp, progress) && temp.overwriteTargetFileWithTemporary();
+}
+
+bool TabEngine::loadFromFile(const juce::File& file)
+{
+    if (auto loaded = readFile(file))
+    {
+        loadDocument(std::move(loaded));
+        return true;
+    }
 
-    if (index >= 0 && index < (int)part->columns.size())
-        return part->columns[index].isBarLine;
     return false;
 }
 
-std::unique_ptr<juce::XmlElement> TabEngine::saveToXML() const
+std::shared_ptr<TabDocument> TabEngine::readFile(const juce::File& file, const ProgressCallback& progress)
 {
-    auto xml = std::make_unique<juce::XmlElement>("TabData");
+    std::shared_ptr<TabDocument> loaded;
 
-    xml->setAttribute("numStrings", numStrings);
-    xml->setAttribute("rootNote", rootNote);
-    xml->setAttribute("tuningType", (int)tuningType);
-    xml->setAttribute("currentSection", currentSectionIndex);
-    xml->setAttribute("currentPart", currentPartIndex);
+    // The mapping stays open for as long as any section still needs it
+    auto mapped = std::make_shared<juce::MemoryMappedFile>(file, juce::MemoryMappedFile::readOnly);
+    auto* data = static_cast<const juce::uint8*>(mapped->getData());
 
-    // Save custom tuning notes
-    juce::String customNotes;
-    for (int i = 0; i < (int)customTuning.notes.size(); ++i)
+    if (data != nullptr && isBinaryState(data, mapped->getSize()))
     {
-        if (i > 0) customNotes += ",";
-        customNotes += customTuning.notes[i];
+        loaded = readBinary(data, mapped->getSize(), mapped, progress);
     }
-    xml->setAttribute("customTuning", customNotes);
+    else
+    {
+        juce::FileInputStream stream(file);
 
-    // Save all sections
-    for (int s = 0; s < (int)sections.size(); ++s)
+        if (stream.openedOk())
+            loaded = readFromStream(stream, progress);
+    }
+
+    // Decoding the current section here keeps it off the message thread
+    if (loaded != nullptr)
+        prepareLoadedDocument(*loaded);
+
+    return loaded;
+}
+
+//==============================================================================
+// Plain-text rendering. Every cell's text is looked up in a table built once,
+// and a part's lines are written straight into one block sized for the
+// longest they could be, so rendering a part costs no allocations per cell or
+// per column.
+namespace TabText
+{
+    constexpr int cellWidth = 4; // Cells are padded on the left with '-' to at least this
+    constexpr int numTechniques = (int)Technique::Harmonic + 1;
+    constexpr int numFrets = 128;
+
+    // A cell's text, padded with zeros so it can always be copied as one
+    // 8-byte block
+    struct Cell
     {
-        auto* sectionXml = xml->createNewChildElement("Section");
-        sectionXml->setAttribute("index", s);
-        sectionXml->setAttribute("name", sections[s].name);
+        char text[8];
+        int length;
+    };
 
-        // Save all parts in this section
-        for (int p = 0; p < (int)sections[s].parts.size(); ++p)
+    static Cell makeCell(int fret, Technique tech, bool beforeFret)
+    {
+        static const char* const symbols[numTechniques] = { "", "h", "p", "/", "\\", "b", "r", "t", "", "~", "" };
+
+        juce::String text;
+
+        if (fret >= 0)
         {
-            auto* partXml = sectionXml->createNewChildElement("Part");
-            partXml->setAttribute("index", p);
-            partXml->setAttribute("name", sections[s].parts[p].name);
-            partXml->setAttribute("numColumns", (int)sections[s].parts[p].columns.size());
+            text = juce::String(fret);
+
+            if (tech == Technique::Mute)
+                text = "x";
+            else if (tech == Technique::Harmonic)
+                text = "<" + text + ">";
+            else if (beforeFret)
+                text = symbols[(int)tech] + text;
+            else
+                text += symbols[(int)tech];
+        }
 
-            for (int col = 0; col < (int)sections[s].parts[p].columns.size(); ++col)
-            {
-                auto* columnXml = partXml->createNewChildElement("Column");
-                columnXml->setAttribute("index", col);
-                columnXml->setAttribute("isBarLine", sections[s].parts[p].columns[col].isBarLine);
+        text = text.paddedLeft('-', cellWidth);
+
+        Cell cell {};
+        cell.length = (int)text.getNumBytesAsUTF8();
+        jassert(cell.length <= (int)sizeof(cell.text));
+        std::memcpy(cell.text, text.toRawUTF8(), (size_t)cell.length);
+        return cell;
+    }
+
+    // Text for every cell there can be: the empty one first, then each fret
+    // with each technique placed after and before it
+    static const Cell* getCellTable()
+    {
+        static const std::vector<Cell> table = []
+        {
+            std::vector<Cell> cells;
+            cells.reserve((size_t)(1 + numFrets * numTechniques * 2));
+            cells.push_back(makeCell(-1, Technique::None, false));
+
+            for (int fret = 0; fret < numFrets; ++fret)
+                for (int tech = 0; tech < numTechniques; ++tech)
+                    for (int beforeFret = 0; beforeFret < 2; ++beforeFret)
+                        cells.push_back(makeCell(fret, (Technique)tech, beforeFret != 0));
+
+            return cells;
+        }();
+
+        return table.data();
+    }
+
+    static size_t getCellIndex(const TabCell& cell)
+    {
+        if (cell.isEmpty())
+            return 0;
+
+        // Techniques this version doesn't know about print as plain frets
+        auto tech = (int)cell.getTechnique();
+
+        if (tech >= numTechniques)
+            tech = 0;
 
-                for (int str = 0; str < numStrings; ++str)
+        return (size_t)(1 + (cell.fret * numTechniques + tech) * 2 + (cell.isTechniqueBeforeFret() ? 1 : 0));
+    }
+
+    static void writeHeader(const TabDocument& doc, juce::OutputStream& out)
+    {
+        static const char* const tuningTypes[] = { "Standard", "Drop", "Open", "Custom" };
+
+        auto type = (int)doc.tuningType;
+
+        out << "Tuning: " << NoteUtils::getNoteName(doc.rootNote) << " "
+            << (juce::isPositiveAndBelow(type, 4) ? tuningTypes[type] : "")
+            << " (" << doc.numStrings << " strings)\n\n";
+    }
+
+    // What the text will take if every cell is the standard width, which
+    // nearly all are. Sections that are still encoded only know their chunk
+    // count, so they're counted as full chunks.
+    static size_t estimateSize(const TabDocument& doc)
+    {
+        size_t numCells = 0;
+        size_t numLines = 0;
+
+        for (const auto& section : doc.sections)
+        {
+            if (section->isDecoded())
+            {
+                for (const auto& part : section->parts)
                 {
-                    int fret = sections[s].parts[p].columns[col].getFret(str);
-                    if (fret >= 0)
-                    {
-                        auto* noteXml = columnXml->createNewChildElement("Note");
-                        noteXml->setAttribute("string", str);
-                        noteXml->setAttribute("fret", fret);
-                        noteXml->setAttribute("technique", (int)sections[s].parts[p].columns[col].getTechnique(str));
-                    }
+                    numCells += (size_t)part->getNumColumns();
+                    ++numLines;
                 }
             }
+            else
+            {
+                numCells += section->encoded.numChunks * (size_t)TabColumnSequence::chunkCapacity;
+                numLines += section->encoded.numChunks;
+            }
         }
+
+        auto numStrings = (size_t)juce::jmax(0, doc.numStrings);
+        return 64 + numStrings * (numCells * (size_t)cellWidth + numLines * 8);
     }
 
-    return xml;
-}
+    // Line starts, highest string first
+    static std::vector<juce::String> getLineNames(const GuitarTuning& tuning, int numStrings)
+    {
+        std::vector<juce::String> names;
 
-void TabEngine::loadFromXML(const juce::XmlElement& xml)
-{
-    if (xml.hasTagName("TabData"))
+        for (int str = numStrings - 1; str >= 0; --str)
+            names.push_back(str < tuning.getNumStrings() ? NoteUtils::getNoteName(tuning.getPitch(str)).paddedRight(' ', 3) + "|-"
+                                                         : juce::String("----"));
+
+        return names;
+    }
+
+    static std::vector<bool> getBarLines(const TabPart& part)
+    {
+        std::vector<bool> barLines((size_t)part.getNumColumns());
+
+        for (int col = 0; col < part.getNumColumns(); ++col)
+            barLines[(size_t)col] = part.isBarLine(col);
+
+        return barLines;
+    }
+
+    // The widest cell in each column, which is all wrapping needs to know
+    // about the notes
+    static std::vector<juce::uint8> getColumnWidths(const TabPart& part, int numStrings)
     {
-        numStrings = xml.getIntAttribute("numStrings", 6);
-        rootNote = xml.getStringAttribute("rootNote", "E");
-        tuningType = (TuningType)xml.getIntAttribute("tuningType", (int)TuningType::Standard);
-        currentSectionIndex = xml.getIntAttribute("currentSection", 0);
-        currentPartIndex = xml.getIntAttribute("currentPart", 0);
+        std::vector<juce::uint8> widths((size_t)part.getNumColumns(), (juce::uint8)cellWidth);
+        const auto* cellTable = getCellTable();
 
-        // Load custom tuning
-        juce::String customNotes = xml.getStringAttribute("customTuning");
-        if (customNotes.isNotEmpty())
+        part.columns.forEachColumn(0, part.getNumColumns(), [&](ConstTabColumn column, int col)
         {
-            customTuning.notes.clear();
-            juce::StringArray noteArray;
-            noteArray.addTokens(customNotes, ",", "");
-            for (auto& note : noteArray)
-                customTuning.notes.push_back(note);
-        }
-        else
+            auto& width = widths[(size_t)col];
+
+            for (int str = 0; str < juce::jmin(numStrings, column.getNumStrings()); ++str)
+                width = (juce::uint8)juce::jmax((int)width, cellTable[getCellIndex(column[str])].length);
+        });
+
+        return widths;
+    }
+
+    // Breaks a part into systems whose lines are at most wrapWidth characters
+    // long, in a single pass over its columns. A system that runs out of room
+    // ends before its last bar line if it has one; otherwise it ends at the
+    // column that didn't fit. A column wider than wrapWidth gets a system to
+    // itself. Returns the first column of each system.
+    static std::vector<int> layoutSystems(const std::vector<juce::uint8>& columnWidths, const std::vector<bool>& barLines,
+                                          int nameWidth, int wrapWidth)
+    {
+        int numColumns = (int)columnWidths.size();
+
+        // Where each column ends, counting the "-|-" before bar lines
+        std::vector<int> ends((size_t)numColumns + 1);
+
+        for (int col = 0; col < numColumns; ++col)
+            ends[(size_t)col + 1] = ends[(size_t)col] + columnWidths[(size_t)col] + (barLines[(size_t)col] ? 3 : 0);
+
+        // The name already ends in a bar, so a system starting on a bar line
+        // leaves its "-|-" out
+        auto getLineWidth = [&](int start, int end)
         {
-            // Fallback to updating tuning
-            updateTuning();
-        }
+            return nameWidth + ends[(size_t)end] - ends[(size_t)start] - (start > 0 && barLines[(size_t)start] ? 3 : 0) + 2;
+        };
+
+        std::vector<int> starts { 0 };
+        int start = 0;
+        int lastBarLine = 0;
 
-        // Load sections
-        sections.clear();
-        for (auto* sectionXml : xml.getChildIterator())
+        for (int col = 0; col < numColumns; ++col)
         {
-            if (sectionXml->hasTagName("Section"))
+            if (barLines[(size_t)col])
+                lastBarLine = col;
+
+            while (col > start && getLineWidth(start, col + 1) > wrapWidth)
             {
-                juce::String sectionName = sectionXml->getStringAttribute("name", "Untitled");
+                start = lastBarLine > start ? lastBarLine : col;
+                starts.push_back(start);
+            }
+        }
+
+        return starts;
+    }
+
+    // Renders a part's string lines into text, one system after another with
+    // a blank line between them, and the end of each line. Without column
+    // widths the cells keep their own widths; with them, each cell is padded
+    // out to its column's width so the strings of a system stay lined up.
+    static void renderPart(const TabPart& part, const std::vector<juce::String>& names, const std::vector<bool>& barLines,
+                           const std::vector<int>& systemStarts, const std::vector<juce::uint8>* columnWidths,
+                           juce::MemoryBlock& text, std::vector<size_t>& lineEnds)
+    {
+        int numStrings = (int)names.size();
+        int numColumns = part.getNumColumns();
+        auto numBarLines = (size_t)std::count(barLines.begin(), barLines.end(), true);
+        size_t longestName = 0;
+
+        for (const auto& name : names)
+            longestName = juce::jmax(longestName, name.getNumBytesAsUTF8());
+
+        // Names, cells (with room to copy each as a whole block after any
+        // padding), "-|-" before each bar line, the closing "-|\n" and the
+        // blank lines between systems
+        auto maxCellLength = (size_t)(cellWidth + (int)sizeof(Cell::text));
+        auto maxStringLength = (longestName + 3) * systemStarts.size() + (size_t)numColumns * maxCellLength + numBarLines * 3;
+
+        text.setSize(maxStringLength * (size_t)numStrings + systemStarts.size());
+        lineEnds.clear();
 
-                // Create section with no columns (we'll add parts)
-                TabSection section;
-                section.name = sectionName;
-                section.parts.clear();
+        const auto* cellTable = getCellTable();
+        auto* start = static_cast<char*>(text.getData());
+        auto* dest = start;
+
+        auto append = [&dest](const char* source, size_t length)
+        {
+            std::memcpy(dest, source, length);
+            dest += length;
+        };
+
+        for (size_t system = 0; system < systemStarts.size(); ++system)
+        {
+            int firstColumn = systemStarts[system];
+            int endColumn = system + 1 < systemStarts.size() ? systemStarts[system + 1] : numColumns;
+
+            if (system > 0)
+                append("\n", 1);
+
+            for (int str = numStrings - 1; str >= 0; --str)
+            {
+                const auto& name = names[(size_t)(numStrings - 1 - str)];
+                append(name.toRawUTF8(), name.getNumBytesAsUTF8());
 
-                // Load parts
-                for (auto* partXml : sectionXml->getChildIterator())
+                part.columns.forEachColumn(firstColumn, endColumn, [&](ConstTabColumn column, int col)
                 {
-                    if (partXml->hasTagName("Part"))
-                    {
-                        juce::String partName = partXml->getStringAttribute("name", "Part 1");
-                        int numCols = partXml->getIntAttribute("numColumns", 16);
+                    // Bar line columns can also hold notes, which come after
+                    // the bar. A system's first bar is the one after its name.
+                    if (barLines[(size_t)col] && (col > firstColumn || col == 0))
+                        append("-|-", 3);
 
-                        section.parts.push_back(TabPart(partName, numStrings, numCols));
-                        int pIndex = (int)section.parts.size() - 1;
+                    const auto& cell = cellTable[str < column.getNumStrings() ? getCellIndex(column[str]) : 0];
 
-                        for (auto* columnXml : partXml->getChildIterator())
-                        {
-                            if (columnXml->hasTagName("Column"))
-                            {
-                                int colIndex = columnXml->getIntAttribute("index");
-                                bool isBarLine = columnXml->getBoolAttribute("isBarLine", false);
-
-                                if (colIndex >= 0 && colIndex < numCols)
-                                {
-                                    section.parts[pIndex].columns[colIndex].isBarLine = isBarLine;
-
-                                    for (auto* noteXml : columnXml->getChildIterator())
-                                    {
-                                        if (noteXml->hasTagName("Note"))
-                                        {
-                                            int str = noteXml->getIntAttribute("string");
-                                            int fret = noteXml->getIntAttribute("fret");
-                                            int tech = noteXml->getIntAttribute("technique", (int)Technique::None);
-                                            section.parts[pIndex].columns[colIndex].setFret(str, fret);
-                                            section.parts[pIndex].columns[colIndex].setTechnique(str, (Technique)tech);
-                                        }
-                                    }
-                                }
-                            }
-                        }
+                    if (columnWidths != nullptr)
+                    {
+                        auto padding = (size_t)((*columnWidths)[(size_t)col] - cell.length);
+                        std::memset(dest, '-', padding);
+                        dest += padding;
                     }
-                }
 
-                // Ensure section has at least one part
-                if (section.parts.empty())
-                    section.parts.push_back(TabPart("Part 1", numStrings, 16));
+                    std::memcpy(dest, cell.text, sizeof(cell.text));
+                    dest += cell.length;
+                });
 
-                sections.push_back(section);
+                append("-|\n", 3);
+                lineEnds.push_back((size_t)(dest - start));
             }
         }
 
-        // Ensure we have at least one section
-        if (sections.empty())
-            sections.push_back(TabSection("Intro", numStrings, 16));
+        text.setSize((size_t)(dest - start));
+    }
+}
 
-        // Validate current indices
-        if (currentSectionIndex >= (int)sections.size())
-            currentSectionIndex = 0;
+juce::String TabEngine::exportToText(int wrapWidth) const
+{
+    auto snapshot = getSnapshot();
+    juce::MemoryOutputStream out(TabText::estimateSize(*snapshot));
 
-        if (currentSectionIndex >= 0 && currentSectionIndex < (int)sections.size())
-        {
-            if (currentPartIndex >= (int)sections[currentSectionIndex].parts.size())
-                currentPartIndex = 0;
-        }
+    {
+        const juce::ScopedLock lock(renderedTextLock);
 
-        notifyListeners();
+        TextRenderings rendered;
+        writeText(*snapshot, out, wrapWidth, rendered, &renderedText);
+        renderedText = std::move(rendered);
     }
+
+    return out.toUTF8();
+}
+
+juce::String TabEngine::exportToText(const TabDocument& doc, int wrapWidth)
+{
+    juce::MemoryOutputStream out(TabText::estimateSize(doc));
+    writeText(doc, out, wrapWidth);
+    return out.toUTF8();
+}
+
+void TabEngine::writeText(const TabDocument& doc, juce::OutputStream& out, int wrapWidth)
+{
+    TextRenderings rendered;
+    writeText(doc, out, wrapWidth, rendered, nullptr);
 }
 
-juce::String TabEngine::exportToText() const
+void TabEngine::writeText(const TabDocument& doc, juce::OutputStream& out, int wrapWidth,
+                          TextRenderings& rendered, TextRenderings* cache)
 {
-    juce::String output;
-    auto tuning = getCurrentTuning();
+    std::vector<std::shared_ptr<const TabSection>> sections;
+    sections.reserve(doc.sections.size());
 
-    // Header - create tuning description
-    juce::String tuningDesc = rootNote + " ";
-    switch (tuningType)
+    for (const auto& section : doc.sections)
     {
-        case TuningType::Standard: tuningDesc += "Standard"; break;
-        case TuningType::Drop: tuningDesc += "Drop"; break;
-        case TuningType::Open: tuningDesc += "Open"; break;
-        case TuningType::Custom: tuningDesc += "Custom"; break;
+        if (section->isDecoded())
+        {
+            sections.push_back(section);
+            continue;
+        }
+
+        auto& entry = rendered.sections[section.get()];
+
+        if (entry.section == nullptr && cache != nullptr)
+        {
+            auto cached = cache->sections.find(section.get());
+
+            if (cached != cache->sections.end() && cached->second.numStrings == doc.numStrings)
+                entry = std::move(cached->second);
+        }
+
+        if (entry.section == nullptr)
+            entry = { section, decoded(section, doc.numStrings), doc.numStrings };
+
+        sections.push_back(entry.section);
     }
 
-    output += "Tuning: " + tuningDesc + " (" + juce::String(numStrings) + " strings)\n\n";
+    // Work out which parts need rendering. Parts shared between sections are
+    // only rendered once. As with saving, a part node that's still in the
+    // cache hasn't changed since it was rendered, so only new nodes (or a new
+    // tuning, which renames the strings) cost a render. A node wrapped to a
+    // different width is rendered again, but keeps its measurements.
+    std::vector<RenderedPart*> pending;
+    size_t pendingColumns = 0;
 
-    // Export all sections
-    for (int s = 0; s < (int)sections.size(); ++s)
+    for (const auto& section : sections)
     {
-        output += "[ " + sections[s].name + " ]\n\n";
-
-        // Export all parts in this section
-        for (int p = 0; p < (int)sections[s].parts.size(); ++p)
+        for (const auto& part : section->parts)
         {
-            // Show part name if there's more than one part
-            if (sections[s].parts.size() > 1)
-                output += "  " + sections[s].parts[p].name + "\n\n";
+            auto& entry = rendered.parts[part.get()];
 
-            // Draw each string
-            for (int str = numStrings - 1; str >= 0; --str)
+            if (entry.part != nullptr)
+                continue;
+
+            if (cache != nullptr)
             {
-                // String name
-                if (str < (int)tuning.notes.size())
-                    output += tuning.notes[str].paddedRight(' ', 3) + "|-";
-                else
-                    output += "----";
+                auto cached = cache->parts.find(part.get());
 
-                // Notes on this string
-                for (int col = 0; col < (int)sections[s].parts[p].columns.size(); ++col)
+                if (cached != cache->parts.end() && cached->second.tuning == doc.tuning
+                    && cached->second.numStrings == doc.numStrings)
                 {
-                    bool isBarLine = sections[s].parts[p].columns[col].isBarLine;
+                    entry = std::move(cached->second);
 
-                    // If this column is marked as a bar line, insert the bar line visual first
-                    if (isBarLine)
-                    {
-                        output += "-|-";
-                    }
+                    if (entry.wrapWidth == wrapWidth)
+                        continue;
+                }
+            }
 
-                    // Then always render the note data (bar line columns can also hold notes)
-                    int fret = sections[s].parts[p].columns[col].getFret(str);
-                    Technique tech = sections[s].parts[p].columns[col].getTechnique(str);
-                    bool beforeFret = sections[s].parts[p].columns[col].isTechniqueBeforeFret(str);
+            entry.part = part;
+            entry.tuning = doc.tuning;
+            entry.numStrings = doc.numStrings;
+            entry.wrapWidth = wrapWidth;
+            pending.push_back(&entry);
+            pendingColumns += (size_t)part->getNumColumns();
+        }
+    }
 
-                    if (fret >= 0)
-                    {
-                        juce::String fretStr = juce::String(fret);
-                        juce::String techStr = "";
-
-                        // Get technique symbol
-                        if (tech == Technique::HammerOn)
-                            techStr = "h";
-                        else if (tech == Technique::PullOff)
-                            techStr = "p";
-                        else if (tech == Technique::SlideUp)
-                            techStr = "/";
-                        else if (tech == Technique::SlideDown)
-                            techStr = "\\";
-                        else if (tech == Technique::Bend)
-                            techStr = "b";
-                        else if (tech == Technique::ReleaseBend)
-                            techStr = "r";
-                        else if (tech == Technique::Tap)
-                            techStr = "t";
-                        else if (tech == Technique::Vibrato)
-                            techStr = "~";
-
-                        // Special cases that don't follow before/after pattern
-                        if (tech == Technique::Mute)
-                        {
-                            fretStr = "x";
-                        }
-                        else if (tech == Technique::Harmonic)
-                        {
-                            fretStr = "<" + fretStr + ">";
-                        }
-                        else if (!techStr.isEmpty())
-                        {
-                            // Apply technique before or after based on flag
-                            if (beforeFret)
-                                fretStr = techStr + fretStr;
-                            else
-                                fretStr = fretStr + techStr;
-                        }
+    // Each part gets its own block, and the blocks are joined in document
+    // order below, so parts can be rendered on different threads. As with
+    // loading XML there's a thread for every few thousand columns, which
+    // leaves a refresh after a small edit on the calling thread.
+    auto names = TabText::getLineNames(doc.tuning, doc.numStrings);
+    int nameWidth = 0;
 
-                        // Determine padding width based on the actual string length
-                        // Maximum expected: <24> = 4 chars, or 24h = 3 chars
-                        // Use 4 characters as standard width for all cells
-                        int padWidth = 4;
-                        output += fretStr.paddedLeft('-', padWidth);
-                    }
-                    else
-                    {
-                        // Empty cell - use same padding as fret cells
-                        output += "----";
-                    }
-                }
+    for (const auto& name : names)
+        nameWidth = juce::jmax(nameWidth, name.length());
 
-                // Add spacing before end bar
-                output += "-";
+    parallelFor(pending.size(), pendingColumns / 4096 + 1, [&](size_t i)
+    {
+        auto& entry = *pending[i];
+        const auto& part = *entry.part;
 
-                output += "|\n";
-            }
+        if (entry.barLines.size() != (size_t)part.getNumColumns())
+            entry.barLines = TabText::getBarLines(part);
 
-            output += "\n";
+        if (wrapWidth <= 0)
+        {
+            TabText::renderPart(part, names, entry.barLines, { 0 }, nullptr, entry.text, entry.lineEnds);
         }
-    }
+        else
+        {
+            if (entry.columnWidths.size() != (size_t)part.getNumColumns())
+                entry.columnWidths = TabText::getColumnWidths(part, doc.numStrings);
+
+            auto systemStarts = TabText::layoutSystems(entry.columnWidths, entry.barLines, nameWidth, wrapWidth);
+            TabText::renderPart(part, names, entry.barLines, systemStarts, &entry.columnWidths, entry.text, entry.lineEnds);
+        }
+    });
+
+    TabText::writeHeader(doc, out);
+
+    for (const auto& section : sections)
+    {
+        out << "[ " << section->name << " ]\n\n";
+
+        for (const auto& part : section->parts)
+        {
+            // Show part name if there's more than one part
+            if (section->getNumParts() > 1)
+                out << "  " << part->name << "\n\n";
 
-    return output;
+            const auto& rendering = rendered.parts[part.get()];
+            out.write(rendering.text.getData(), rendering.text.getSize());
+            out << "\n";
+        }
+    }
 }
 
 void TabEngine::addListener(Listener* listener)
@@ -892,7 +4234,61 @@ void TabEngine::removeListener(Listener* listener)
     listeners.remove(listener);
 }
 
-void TabEngine::notifyListeners()
+TabChange TabEngine::cellsInCurrentPart(juce::Range<int> columns, juce::Range<int> strings) const
+{
+    return TabChange::cells(document->currentSectionIndex, document->currentPartIndex, columns, strings);
+}
+
+TabChange TabEngine::columnsInCurrentPart(int firstColumn) const
+{
+    return TabChange::columnsFrom(document->currentSectionIndex, document->currentPartIndex, firstColumn);
+}
+
+void TabEngine::notifyListeners(const TabChange& change)
+{
+    {
+        const juce::SpinLock::ScopedLockType lock(documentLock);
+        pendingChange.merge(change);
+    }
+
+    // Inside a transaction the notification and the undo step wait for the
+    // outermost one to close
+    if (transactionDepth > 0)
+    {
+        notificationPending = true;
+    }
+    else
+    {
+        journal.closeStep();
+        triggerAsyncUpdate();
+    }
+}
+
+void TabEngine::endTransaction()
+{
+    jassert(transactionDepth > 0);
+
+    if (--transactionDepth == 0)
+    {
+        journal.closeStep();
+
+        if (notificationPending)
+        {
+            notificationPending = false;
+            triggerAsyncUpdate();
+        }
+    }
+}
+
+void TabEngine::handleAsyncUpdate()
 {
-    listeners.call(&Listener::tabDataChanged);
+    TabChange change;
+
+    {
+        const juce::SpinLock::ScopedLockType lock(documentLock);
+        std::swap(change, pendingChange);
+    }
+
+    if (!change.isEmpty())
+        listeners.call([&change](Listener& l) { l.tabDataChanged(change); });
 }
@@ -3,9 +3,14 @@
 #include <JuceHeader.h>
 #include <vector>
 #include <map>
+#include <array>
+#include <algorithm>
+#include <memory>
+#include <deque>
 
 //==============================================================================
-// Note utilities
+// Note utilities. Pitches are MIDI note numbers (E2 = 40); names are only
+// produced here, at the UI edge.
 class NoteUtils
 {
 public:
@@ -14,23 +19,37 @@ public:
         return { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
     }
 
+    // Shared name for a pitch class or pitch, so callers never build a new String
+    static const juce::String& getNoteName(int pitch)
+    {
+        static const juce::String names[12] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+        return names[getPitchClass(pitch)];
+    }
+
+    // Pitch class (0 = C) of a note name, or -1 if it isn't one
     static int getNoteIndex(const juce::String& note)
     {
-        auto notes = getAllNotes();
-        return notes.indexOf(note);
+        for (int i = 0; i < 12; ++i)
+            if (getNoteName(i) == note)
+                return i;
+        return -1;
     }
 
-    // Get note that is 'semitones' higher than base note
-    static juce::String transposeNote(const juce::String& note, int semitones)
+    static constexpr int getPitchClass(int pitch)
     {
-        auto notes = getAllNotes();
-        int index = notes.indexOf(note);
-        if (index < 0) return note;
+        return ((pitch % 12) + 12) % 12;
+    }
 
-        index = (index + semitones) % 12;
-        if (index < 0) index += 12;
+    // The pitch with the given pitch class that lies closest to referencePitch
+    static constexpr int getNearestPitch(int pitchClass, int referencePitch)
+    {
+        return referencePitch + getPitchClass(pitchClass - referencePitch + 6) - 6;
+    }
 
-        return notes[index];
+    // Lowest-string pitch for a key: E is E2 and every other key tunes down from it
+    static constexpr int getRootPitch(int pitchClass)
+    {
+        return 40 - getPitchClass(4 - pitchClass);
     }
 };
 
@@ -46,56 +65,164 @@ enum class TuningType
 //==============================================================================
 struct GuitarTuning
 {
-    std::vector<juce::String> notes; // From lowest to highest string
+    static constexpr int maxStrings = 9;
 
-    GuitarTuning() {}
-    GuitarTuning(const std::vector<juce::String>& n) : notes(n) {}
+    std::array<juce::int8, maxStrings> pitches {}; // From lowest to highest string
+    int numStrings = 0;
 
-    // Generate standard tuning for given root note and string count
-    static GuitarTuning createStandard(const juce::String& rootNote, int numStrings)
+    constexpr int getNumStrings() const { return numStrings; }
+    constexpr int getPitch(int stringIndex) const { return pitches[(size_t)stringIndex]; }
+    constexpr int getPitchClass(int stringIndex) const { return NoteUtils::getPitchClass(pitches[(size_t)stringIndex]); }
+
+    constexpr void setPitch(int stringIndex, int pitch)
     {
-        GuitarTuning tuning;
-        // Standard intervals: 0, 5, 10, 15, 19, 24, 29, 34, 39 semitones (up to 9 strings)
-        juce::Array<int> intervals = { 0, 5, 10, 15, 19, 24, 29, 34, 39 };
+        pitches[(size_t)stringIndex] = (juce::int8)pitch;
+    }
+
+    constexpr bool operator==(const GuitarTuning& other) const
+    {
+        if (numStrings != other.numStrings)
+            return false;
 
-        for (int i = 0; i < numStrings && i < intervals.size(); ++i)
-            tuning.notes.push_back(NoteUtils::transposeNote(rootNote, intervals[i]));
+        for (int i = 0; i < numStrings; ++i)
+            if (pitches[(size_t)i] != other.pitches[(size_t)i])
+                return false;
 
-        return tuning;
+        return true;
     }
 
-    // Generate drop tuning - rootNote is the dropped string note (e.g., "D" for Drop D)
-    // The rest follows standard tuning from 2 semitones up
-    static GuitarTuning createDrop(const juce::String& rootNote, int numStrings)
+    // Grow or shrink to n strings; new strings are tuned to the next E above the one below
+    constexpr void resize(int n)
     {
-        GuitarTuning tuning;
-        // First string is the root (dropped string)
-        tuning.notes.push_back(rootNote);
+        n = n < 0 ? 0 : (n > maxStrings ? maxStrings : n);
 
-        // Rest follows standard intervals from 2 semitones above the drop note
-        juce::String standardRoot = NoteUtils::transposeNote(rootNote, 2);
-        juce::Array<int> intervals = { 5, 10, 15, 19, 24, 29, 34, 39 }; // Skip first (0)
+        for (int i = numStrings; i < n; ++i)
+        {
+            int below = i == 0 ? 28 : pitches[(size_t)i - 1];
+            int pitch = NoteUtils::getNearestPitch(4, below + 5);
+            pitches[(size_t)i] = (juce::int8)(pitch > below ? pitch : pitch + 12);
+        }
+
+        numStrings = n;
+    }
 
-        for (int i = 1; i < numStrings && (i-1) < intervals.size(); ++i)
-            tuning.notes.push_back(NoteUtils::transposeNote(standardRoot, intervals[i-1]));
+    static constexpr GuitarTuning fromIntervals(int rootPitch, const std::array<juce::int8, maxStrings>& intervals, int n)
+    {
+        GuitarTuning tuning;
+        tuning.numStrings = n < 0 ? 0 : (n > maxStrings ? maxStrings : n);
+
+        for (int i = 0; i < tuning.numStrings; ++i)
+            tuning.pitches[(size_t)i] = (juce::int8)(rootPitch + intervals[(size_t)i]);
 
         return tuning;
     }
 
-    // Generate open tuning (major chord)
-    static GuitarTuning createOpen(const juce::String& rootNote, int numStrings)
+    template <size_t N>
+    static constexpr GuitarTuning fromPitches(const int (&stringPitches)[N])
     {
+        static_assert(N <= maxStrings, "Too many strings");
+
         GuitarTuning tuning;
-        // Open major chord intervals: Root, 5th, Root, 3rd, 5th, Root, 5th, Root, 3rd
-        juce::Array<int> intervals = { 0, 7, 12, 16, 19, 24, 31, 36, 40 };
+        tuning.numStrings = (int)N;
 
-        for (int i = 0; i < numStrings && i < intervals.size(); ++i)
-            tuning.notes.push_back(NoteUtils::transposeNote(rootNote, intervals[i]));
+        for (size_t i = 0; i < N; ++i)
+            tuning.pitches[i] = (juce::int8)stringPitches[i];
 
         return tuning;
     }
+
+    // Standard intervals: 0, 5, 10, 15, 19, 24, 29, 34, 39 semitones (up to 9 strings)
+    static GuitarTuning createStandard(int rootPitchClass, int numStrings);
+
+    // Drop tuning - rootPitchClass is the dropped string (e.g. D for Drop D),
+    // the rest follows standard tuning from 2 semitones up
+    static GuitarTuning createDrop(int rootPitchClass, int numStrings);
+
+    // Open major chord: Root, 5th, Root, 3rd, 5th, Root, 5th, Root, 3rd
+    static GuitarTuning createOpen(int rootPitchClass, int numStrings);
 };
 
+//==============================================================================
+// Every Standard/Drop/Open tuning for every key and string count, plus a
+// catalogue of well-known named tunings, all generated at compile time.
+namespace TuningTables
+{
+    constexpr std::array<juce::int8, GuitarTuning::maxStrings> standardIntervals { 0, 5, 10, 15, 19, 24, 29, 34, 39 };
+    constexpr std::array<juce::int8, GuitarTuning::maxStrings> dropIntervals     { 0, 7, 12, 17, 21, 26, 31, 36, 41 };
+    constexpr std::array<juce::int8, GuitarTuning::maxStrings> openIntervals     { 0, 7, 12, 16, 19, 24, 31, 36, 40 };
+
+    constexpr int numShapes = 3; // Standard, Drop, Open
+
+    using Table = std::array<GuitarTuning, numShapes * 12 * GuitarTuning::maxStrings>;
+
+    constexpr Table build()
+    {
+        const std::array<juce::int8, GuitarTuning::maxStrings>* shapes[numShapes] = { &standardIntervals, &dropIntervals, &openIntervals };
+        Table table {};
+
+        for (int shape = 0; shape < numShapes; ++shape)
+            for (int key = 0; key < 12; ++key)
+                for (int n = 1; n <= GuitarTuning::maxStrings; ++n)
+                    table[(size_t)((shape * 12 + key) * GuitarTuning::maxStrings + n - 1)]
+                        = GuitarTuning::fromIntervals(NoteUtils::getRootPitch(key), *shapes[shape], n);
+
+        return table;
+    }
+
+    inline constexpr Table presets = build();
+
+    // shape is (int)TuningType for Standard, Drop or Open
+    constexpr const GuitarTuning& lookup(int shape, int rootPitchClass, int numStrings)
+    {
+        numStrings = numStrings < 1 ? 1 : (numStrings > GuitarTuning::maxStrings ? GuitarTuning::maxStrings : numStrings);
+        return presets[(size_t)((shape * 12 + NoteUtils::getPitchClass(rootPitchClass)) * GuitarTuning::maxStrings + numStrings - 1)];
+    }
+
+    struct NamedTuning
+    {
+        const char* name;
+        GuitarTuning tuning;
+    };
+
+    inline constexpr NamedTuning named[] =
+    {
+        { "Drop D",            GuitarTuning::fromPitches({ 38, 45, 50, 55, 59, 64 }) },
+        { "Double Drop D",     GuitarTuning::fromPitches({ 38, 45, 50, 55, 59, 62 }) },
+        { "D Standard",        GuitarTuning::fromPitches({ 38, 43, 48, 53, 57, 62 }) },
+        { "Drop C",            GuitarTuning::fromPitches({ 36, 43, 48, 53, 57, 62 }) },
+        { "DADGAD",            GuitarTuning::fromPitches({ 38, 45, 50, 55, 57, 62 }) },
+        { "Open D",            GuitarTuning::fromPitches({ 38, 45, 50, 54, 57, 62 }) },
+        { "Open E",            GuitarTuning::fromPitches({ 40, 47, 52, 56, 59, 64 }) },
+        { "Open G",            GuitarTuning::fromPitches({ 38, 43, 50, 55, 59, 62 }) },
+        { "Open C",            GuitarTuning::fromPitches({ 36, 43, 48, 55, 60, 64 }) },
+        { "Open A",            GuitarTuning::fromPitches({ 40, 45, 52, 57, 61, 64 }) },
+        { "7-String Standard", GuitarTuning::fromPitches({ 35, 40, 45, 50, 55, 59, 64 }) },
+        { "8-String Standard", GuitarTuning::fromPitches({ 30, 35, 40, 45, 50, 55, 59, 64 }) },
+        { "Bass Standard",     GuitarTuning::fromPitches({ 28, 33, 38, 43 }) },
+        { "5-String Bass",     GuitarTuning::fromPitches({ 23, 28, 33, 38, 43 }) },
+    };
+
+    constexpr int numNamed = (int)(sizeof (named) / sizeof (named[0]));
+
+    static_assert(lookup(0, 4, 6).getPitch(0) == 40 && lookup(0, 4, 6).getPitch(5) == 64, "E standard is E2..E4");
+    static_assert(lookup(1, 2, 6).getPitch(0) == 38 && lookup(1, 2, 6).getPitch(1) == 45, "Drop D starts D2 A2");
+}
+
+inline GuitarTuning GuitarTuning::createStandard(int rootPitchClass, int numStrings)
+{
+    return TuningTables::lookup((int)TuningType::Standard, rootPitchClass, numStrings);
+}
+
+inline GuitarTuning GuitarTuning::createDrop(int rootPitchClass, int numStrings)
+{
+    return TuningTables::lookup((int)TuningType::Drop, rootPitchClass, numStrings);
+}
+
+inline GuitarTuning GuitarTuning::createOpen(int rootPitchClass, int numStrings)
+{
+    return TuningTables::lookup((int)TuningType::Open, rootPitchClass, numStrings);
+}
+
 //==============================================================================
 enum class Technique
 {
@@ -113,133 +240,523 @@ enum class Technique
 };
 
 //==============================================================================
-struct TabNote
+// One string's worth of data inside a column, packed into two bytes
+struct TabCell
 {
-    int stringIndex;  // Which string (0 = lowest)
-    int fret;         // Fret number (-1 for empty)
-    Technique technique; // Technique applied to this note
-    bool techniqueBeforeFret; // True if technique appears before fret (e.g., /5 vs 5/)
+    static constexpr juce::uint8 techniqueMask = 0x7f;
+    static constexpr juce::uint8 beforeFretFlag = 0x80;
 
-    TabNote() : stringIndex(0), fret(-1), technique(Technique::None), techniqueBeforeFret(false) {}
-    TabNote(int string, int fretNum) : stringIndex(string), fret(fretNum), technique(Technique::None), techniqueBeforeFret(false) {}
+    static constexpr int maxFret = 24;
+
+    juce::int8 fret = -1;  // Fret number (-1 for empty)
+    juce::uint8 flags = 0; // Technique in the low bits, top bit set if technique appears before fret
 
     bool isEmpty() const { return fret < 0; }
+
+    bool operator==(const TabCell& other) const { return fret == other.fret && flags == other.flags; }
+    bool operator!=(const TabCell& other) const { return !(*this == other); }
+
+    void setFret(int fretNum) { fret = (juce::int8)juce::jlimit(-1, 127, fretNum); }
+
+    Technique getTechnique() const { return (Technique)(flags & techniqueMask); }
+    bool isTechniqueBeforeFret() const { return (flags & beforeFretFlag) != 0; }
+
+    void setTechnique(Technique tech, bool beforeFret)
+    {
+        flags = (juce::uint8)(((int)tech & techniqueMask) | (beforeFret ? beforeFretFlag : 0));
+    }
 };
 
 //==============================================================================
-struct TabColumn
+// Lightweight view of one column inside a TabPart's cell buffer
+template <typename CellType>
+class TabColumnView
 {
-    std::vector<TabNote> notes; // One note per string
-    bool isBarLine; // True if this column is a bar line separator
+public:
+    TabColumnView(CellType* columnCells, int numStrings)
+        : cells(columnCells), size(numStrings) {}
 
-    TabColumn(int numStrings = 6, bool barLine = false)
-        : isBarLine(barLine)
-    {
-        notes.resize(numStrings);
-        for (int i = 0; i < numStrings; ++i)
-            notes[i] = TabNote(i, -1);
-    }
+    int getNumStrings() const { return size; }
 
     void setFret(int stringIndex, int fret)
     {
-        if (stringIndex >= 0 && stringIndex < (int)notes.size())
-            notes[stringIndex].fret = fret;
+        if (stringIndex >= 0 && stringIndex < size)
+            cells[stringIndex].setFret(fret);
     }
 
     int getFret(int stringIndex) const
     {
-        if (stringIndex >= 0 && stringIndex < (int)notes.size())
-            return notes[stringIndex].fret;
+        if (stringIndex >= 0 && stringIndex < size)
+            return cells[stringIndex].fret;
         return -1;
     }
 
     void setTechnique(int stringIndex, Technique tech, bool beforeFret = false)
     {
-        if (stringIndex >= 0 && stringIndex < (int)notes.size())
-        {
-            notes[stringIndex].technique = tech;
-            notes[stringIndex].techniqueBeforeFret = beforeFret;
-        }
+        if (stringIndex >= 0 && stringIndex < size)
+            cells[stringIndex].setTechnique(tech, beforeFret);
     }
 
     Technique getTechnique(int stringIndex) const
     {
-        if (stringIndex >= 0 && stringIndex < (int)notes.size())
-            return notes[stringIndex].technique;
+        if (stringIndex >= 0 && stringIndex < size)
+            return cells[stringIndex].getTechnique();
         return Technique::None;
     }
 
     bool isTechniqueBeforeFret(int stringIndex) const
     {
-        if (stringIndex >= 0 && stringIndex < (int)notes.size())
-            return notes[stringIndex].techniqueBeforeFret;
+        if (stringIndex >= 0 && stringIndex < size)
+            return cells[stringIndex].isTechniqueBeforeFret();
         return false;
     }
+
+    CellType& operator[](int stringIndex) const
+    {
+        jassert(stringIndex >= 0 && stringIndex < size);
+        return cells[stringIndex];
+    }
+
+    void clear()
+    {
+        std::fill(cells, cells + size, TabCell());
+    }
+
+private:
+    CellType* cells;
+    int size;
+};
+
+using TabColumn = TabColumnView<TabCell>;
+using ConstTabColumn = TabColumnView<const TabCell>;
+
+//==============================================================================
+// Ordered sequence of columns, stored as a list of fixed-capacity chunks.
+// Each chunk keeps its cells in one flat buffer (column-major, lowest string
+// first) plus a bar-line bitmap, so inserting or deleting a column only shifts
+// the columns inside one chunk however long the part gets.
+//
+// Chunks are shared between copies of a sequence and copied on write, so
+// copying a sequence only copies its chunk pointers.
+class TabColumnSequence
+{
+public:
+    static constexpr int chunkCapacity = 64;
+    static constexpr int maxStrings = 9;
+
+private:
+    struct Chunk;
+
+public:
+    // Carves chunks out of one shared slab, so building a whole document costs
+    // a single allocation for its column storage. Each chunk keeps the slab
+    // alive, so the arena itself can be dropped as soon as loading is done.
+    // Chunks still get their own reference counts, so copy-on-write sees them
+    // exactly like separately allocated ones. Counts come from files, so the
+    // slab never reserves more than maxChunks; any chunks past that are
+    // allocated one at a time as they're actually read.
+    class ChunkArena
+    {
+    public:
+        explicit ChunkArena(size_t numChunks);
+
+        static constexpr size_t maxChunks = 16384; // About a million columns, 20 MB
+
+        static size_t chunksNeeded(int numCols);
+
+    private:
+        friend class TabColumnSequence;
+
+        template <typename T>
+        struct Allocator;
+
+        std::shared_ptr<Chunk> allocate();
+
+        std::shared_ptr<char[]> slab;
+        size_t capacity;
+        size_t used = 0;
+    };
+
+    TabColumnSequence(int numStrings = 6, int numCols = 0);
+    TabColumnSequence(int numStrings, int numCols, ChunkArena& arena);
+
+    int getNumStrings() const { return stride; }
+    int size() const { return numColumns; }
+
+    // Bytes of cell storage held, counting shared chunks in full
+    size_t getStorageBytes() const { return chunks.size() * sizeof(Chunk); }
+
+    TabColumn getColumn(int index);
+    ConstTabColumn getColumn(int index) const;
+
+    bool isBarLine(int index) const;
+    void setBarLine(int index, bool barLine);
+
+    // Replace the contents with numCols empty columns
+    void reset(int numStrings, int numCols);
+
+    void insert(int beforeIndex, bool barLine = false);
+    void remove(int index);
+
+    // Inserts copies of the count columns from sourceStart before
+    // beforeIndex. The copies are packed into new chunks and spliced in
+    // whole, so the later chunks only have their starts updated once.
+    void insertCopies(int beforeIndex, int sourceStart, int count);
+
+    int getNumChunks() const { return (int)chunks.size(); }
+
+    // Appends the columns of other, sharing its chunks rather than copying
+    // them, so sequences assembled from the same pieces store them once
+    void append(const TabColumnSequence& other);
+
+    // Returns a copy with the same columns and bar lines but a different
+    // string count, with fn(oldColumn, newColumn) filling in each column
+    template <typename Fn>
+    TabColumnSequence withNumStrings(int newNumStrings, ChunkArena& arena, Fn&& fn) const;
+
+    // Calls fn(column, columnIndex) for every column in [start, end), walking
+    // the storage chunk by chunk so each chunk is found (and copied on write)
+    // once rather than once per column
+    template <typename Fn>
+    void forEachColumn(int start, int end, Fn&& fn);
+
+    template <typename Fn>
+    void forEachColumn(int start, int end, Fn&& fn) const;
+
+private:
+    static_assert(chunkCapacity <= 64, "Bar-line bitmap is a single 64-bit word");
+
+    struct Chunk
+    {
+        int numColumns = 0;
+        juce::uint64 barLines = 0; // Bit n set if column n is a bar line
+        TabCell cells[chunkCapacity * maxStrings];
+    };
+
+    int stride = 6;
+    int numColumns = 0;
+    std::vector<std::shared_ptr<Chunk>> chunks;
+    std::vector<int> chunkStarts; // Index of the first column in each chunk
+
+    void rebuild(int numStrings, int numCols, ChunkArena* arena);
+    int findChunk(int index) const;
+    Chunk& editChunk(int chunkIndex);
+    void splitChunk(int chunkIndex, int keep);
+    void mergeWithNext(int chunkIndex);
+};
+
+template <typename Fn>
+void TabColumnSequence::forEachColumn(int start, int end, Fn&& fn)
+{
+    for (int c = start < end ? findChunk(start) : 0; start < end; ++c)
+    {
+        auto& chunk = editChunk(c);
+        int first = chunkStarts[(size_t)c];
+        int stop = juce::jmin(end, first + chunk.numColumns);
+
+        for (; start < stop; ++start)
+            fn(TabColumn(chunk.cells + (start - first) * stride, stride), start);
+    }
+}
+
+template <typename Fn>
+TabColumnSequence TabColumnSequence::withNumStrings(int newNumStrings, ChunkArena& arena, Fn&& fn) const
+{
+    TabColumnSequence result(newNumStrings, 0);
+    result.numColumns = numColumns;
+    result.chunkStarts = chunkStarts;
+    result.chunks.reserve(chunks.size());
+
+    for (const auto& chunk : chunks)
+    {
+        auto copy = arena.allocate();
+        copy->numColumns = chunk->numColumns;
+        copy->barLines = chunk->barLines;
+
+        for (int i = 0; i < chunk->numColumns; ++i)
+            fn(ConstTabColumn(chunk->cells + i * stride, stride), TabColumn(copy->cells + i * result.stride, result.stride));
+
+        result.chunks.push_back(std::move(copy));
+    }
+
+    return result;
+}
+
+template <typename Fn>
+void TabColumnSequence::forEachColumn(int start, int end, Fn&& fn) const
+{
+    for (int c = start < end ? findChunk(start) : 0; start < end; ++c)
+    {
+        const auto& chunk = *chunks[(size_t)c];
+        int first = chunkStarts[(size_t)c];
+        int stop = juce::jmin(end, first + chunk.numColumns);
+
+        for (; start < stop; ++start)
+            fn(ConstTabColumn(chunk.cells + (start - first) * stride, stride), start);
+    }
+}
+
+//==============================================================================
+// A rectangle of cells lifted out of a part, stored column by column
+struct TabCellBlock
+{
+    int numColumns = 0;
+    int numStrings = 0;
+    std::vector<TabCell> cells;
+
+    bool isEmpty() const { return cells.empty(); }
+    const TabCell& getCell(int column, int stringIndex) const { return cells[(size_t)(column * numStrings + stringIndex)]; }
 };
 
 //==============================================================================
 struct TabPart
 {
     juce::String name;
-    std::vector<TabColumn> columns;
+    TabColumnSequence columns;
 
     TabPart(const juce::String& partName = "Part 1", int numStrings = 6, int numCols = 16)
-        : name(partName)
+        : name(partName), columns(numStrings, numCols)
+    {
+    }
+
+    TabPart(const juce::String& partName, TabColumnSequence&& partColumns)
+        : name(partName), columns(std::move(partColumns))
+    {
+    }
+
+    int getNumStrings() const { return columns.getNumStrings(); }
+    int getNumColumns() const { return columns.size(); }
+
+    TabColumn getColumn(int index) { return columns.getColumn(index); }
+    ConstTabColumn getColumn(int index) const { return columns.getColumn(index); }
+
+    bool isBarLine(int index) const { return columns.isBarLine(index); }
+    void setBarLine(int index, bool barLine) { columns.setBarLine(index, barLine); }
+
+    void reset(int numStrings, int numCols) { columns.reset(numStrings, numCols); }
+    void insertColumn(int beforeIndex, bool barLine = false) { columns.insert(beforeIndex, barLine); }
+    void removeColumn(int index) { columns.remove(index); }
+
+    // Empty every string in the column and drop its bar line
+    void clearColumn(int index)
     {
-        columns.reserve(numCols);
-        for (int i = 0; i < numCols; ++i)
-            columns.push_back(TabColumn(numStrings));
+        columns.getColumn(index).clear();
+        columns.setBarLine(index, false);
     }
 };
 
 //==============================================================================
 struct TabSection
 {
+    // Where a section opened lazily from a file is still only encoded. Its
+    // parts stay empty until TabEngine decodes it; owner keeps the bytes
+    // (usually a memory-mapped file) alive.
+    struct Encoded
+    {
+        std::shared_ptr<const void> owner;
+        const juce::uint8* data = nullptr;
+        size_t size = 0;
+        size_t numChunks = 0;
+    };
+
     juce::String name;
-    std::vector<TabPart> parts;
+    std::vector<std::shared_ptr<TabPart>> parts;
+    Encoded encoded;
+
+    // A section whose bytes couldn't be decoded is shown as an empty one,
+    // which holds its own copy of them. As long as it's left empty, saving
+    // writes them back as they were.
+    Encoded unreadable;
 
     TabSection(const juce::String& sectionName = "Untitled", int numStrings = 6, int numCols = 16)
         : name(sectionName)
     {
         // Start with one default part
-        parts.push_back(TabPart("Part 1", numStrings, numCols));
+        parts.push_back(std::make_shared<TabPart>("Part 1", numStrings, numCols));
+    }
+
+    TabSection(const juce::String& sectionName, std::vector<std::shared_ptr<TabPart>>&& sectionParts)
+        : name(sectionName), parts(std::move(sectionParts))
+    {
     }
+
+    bool isDecoded() const { return encoded.data == nullptr; }
+
+    int getNumParts() const { return (int)parts.size(); }
+    const TabPart& getPart(int partIndex) const { return *parts[(size_t)partIndex]; }
+};
+
+//==============================================================================
+// The whole song plus its tuning and selection. Sections, parts and column
+// chunks are shared between documents and copied on write, so copying a
+// document only copies the section pointers, and an edit only copies the
+// nodes on the path to the cells it touches.
+struct TabDocument
+{
+    int numStrings = 6;
+    int rootNote = 4; // Pitch class of the key
+    TuningType tuningType = TuningType::Standard;
+    GuitarTuning tuning = GuitarTuning::createStandard(4, 6);
+    int currentSectionIndex = 0;
+    int currentPartIndex = 0;
+    std::vector<std::shared_ptr<TabSection>> sections;
+
+    int getNumSections() const { return (int)sections.size(); }
+    const TabSection& getSection(int sectionIndex) const { return *sections[(size_t)sectionIndex]; }
+};
+
+//==============================================================================
+// Describes what changed since listeners were last notified. Edits that land
+// before the same notification are merged, so a change can cover more than
+// any single edit did.
+struct TabChange
+{
+    enum Kind
+    {
+        cellsEdited      = 1 << 0, // Cells in the columns and strings below
+        columnsChanged   = 1 << 1, // Columns inserted or removed at or after columns.getStart()
+        structureChanged = 1 << 2, // Sections or parts added, removed, renamed or replaced
+        tuningChanged    = 1 << 3,
+        selectionChanged = 1 << 4  // Current section or part
+    };
+
+    int kinds = 0;
+
+    // The part cellsEdited and columnsChanged refer to; -1 if it could be any
+    int sectionIndex = -1;
+    int partIndex = -1;
+
+    juce::Range<int> columns;
+    juce::Range<int> strings;
+
+    bool has(Kind kind) const { return (kinds & kind) != 0; }
+    bool isEmpty() const { return kinds == 0; }
+    bool affectsPart(int section, int part) const;
+
+    static TabChange cells(int section, int part, juce::Range<int> columnRange, juce::Range<int> stringRange);
+    static TabChange columnsFrom(int section, int part, int firstColumn);
+    static TabChange of(int kindFlags);
+    static TabChange everything();
+
+    void merge(const TabChange& other);
+};
+
+//==============================================================================
+// Undo/redo history made of inverse records. A cell edit costs one 16-byte
+// record. Edits that replace a whole section, part or document move the old
+// node into the journal instead, which copies nothing because nodes are
+// shared. Records are grouped into steps, one per undoable action.
+class TabJournal
+{
+public:
+    enum class Op : juce::uint8
+    {
+        setCell,       // Swap cell with the one at (section, part, column, detail)
+        setBarLine,    // Set the column's bar line to detail
+        insertColumn,  // Remove the column that was inserted
+        removeColumn,  // Re-insert an empty column, bar line from detail
+        swapSection,   // Swap the node with section
+        insertSection, // Remove the section that was added
+        removeSection, // Re-insert the node as section
+        swapPart,
+        insertPart,
+        removePart,
+        swapDocument   // Swap the node with the whole document
+    };
+
+    struct Record
+    {
+        Op op = Op::setCell;
+        juce::int8 detail = 0; // String index for setCell, bar-line flag for column ops
+        TabCell cell;
+        juce::int32 column = 0;
+        juce::int32 section = 0;
+        juce::int32 part = 0;
+    };
+
+    // One direction of history. Nodes are consumed in step with the records
+    // whose op carries one.
+    struct Stack
+    {
+        struct Step
+        {
+            size_t numRecords = 0;
+            size_t numNodes = 0;
+            size_t bytes = 0;
+        };
+
+        std::deque<Record> records;
+        std::deque<std::shared_ptr<void>> nodes;
+        std::deque<Step> steps;
+        size_t bytes = 0;
+
+        void push(const Record& record, std::shared_ptr<void> node);
+        void dropOldestStep();
+        void clear();
+    };
+
+    static constexpr size_t defaultMemoryLimit = 4 * 1024 * 1024;
+
+    static bool hasNode(Op op);
+    static size_t getRecordBytes(const Record& record, const std::shared_ptr<void>& node);
+
+    Stack undoStack, redoStack;
+    size_t memoryLimit = defaultMemoryLimit; // For each stack
+    bool stepOpen = false;
+
+    // Adds a record to the open undo step, starting a new step if needed
+    void add(const Record& record, std::shared_ptr<void> node = nullptr);
+    void closeStep();
+    void trimToLimit();
+    void clear();
 };
 
 //==============================================================================
-class TabEngine
+class TabEngine : private juce::AsyncUpdater
 {
 public:
     TabEngine();
     ~TabEngine();
 
-    // Tab structure
-    void setNumStrings(int num);
-    int getNumStrings() const { return numStrings; }
+    // Tab structure. Changing the string count or tuning moves every note to
+    // the nearest free string that plays the same pitch. These return how many
+    // notes found no free string and were dropped, which undoing the change
+    // brings back. A setting that changes nothing isn't recorded at all.
+    int setNumStrings(int num);
+    int getNumStrings() const { return document->numStrings; }
 
     // New tuning system
-    void setRootNote(const juce::String& note);
-    juce::String getRootNote() const { return rootNote; }
+    int setRootNote(const juce::String& note);
+    juce::String getRootNote() const { return NoteUtils::getNoteName(document->rootNote); }
 
-    void setTuningType(TuningType type);
-    TuningType getTuningType() const { return tuningType; }
+    int setTuningType(TuningType type);
+    TuningType getTuningType() const { return document->tuningType; }
 
-    void setCustomStringNote(int stringIndex, const juce::String& note);
+    int setCustomStringNote(int stringIndex, const juce::String& note);
     juce::String getStringNote(int stringIndex) const;
 
-    GuitarTuning getCurrentTuning() const;
+    // Refers into the current document, so it's only good until the next edit
+    const GuitarTuning& getCurrentTuning() const { return document->tuning; }
+
+    // Switch to one of TuningTables::named as a custom tuning
+    int applyNamedTuning(int index);
 
     // Section management
-    int getNumSections() const { return (int)sections.size(); }
+    int getNumSections() const { return document->getNumSections(); }
     void addSection(const juce::String& name = "New Section");
     void removeSection(int sectionIndex);
     void renameSection(int sectionIndex, const juce::String& newName);
     juce::String getSectionName(int sectionIndex) const;
     void setCurrentSection(int sectionIndex);
-    int getCurrentSection() const { return currentSectionIndex; }
+    int getCurrentSection() const { return document->currentSectionIndex; }
     void clearSection(int sectionIndex);
-    std::unique_ptr<juce::XmlElement> copySectionToXML(int sectionIndex) const;
-    void pasteSectionFromXML(int sectionIndex, const juce::XmlElement& xml);
+
+    // Copies hold on to the section's own node. Nodes never change once they
+    // are in a document, so a copy shares all of its columns and pasting
+    // copies nothing until a pasted part is edited. Paste keeps the target's
+    // name.
+    std::shared_ptr<const TabSection> copySection(int sectionIndex) const;
+    void pasteSection(int sectionIndex, const TabSection& clip);
 
     // Part management (within current section)
     int getNumParts() const;
@@ -248,10 +765,10 @@ public:
     void renamePart(int partIndex, const juce::String& newName);
     juce::String getPartName(int partIndex) const;
     void setCurrentPart(int partIndex);
-    int getCurrentPart() const { return currentPartIndex; }
+    int getCurrentPart() const { return document->currentPartIndex; }
     void clearPart(int partIndex);
-    std::unique_ptr<juce::XmlElement> copyPartToXML(int partIndex) const;
-    void pastePartFromXML(int partIndex, const juce::XmlElement& xml);
+    std::shared_ptr<const TabPart> copyPart(int partIndex) const;
+    void pastePart(int partIndex, const std::shared_ptr<const TabPart>& clip);
 
     void setNumColumns(int num);
     int getNumColumns() const;
@@ -270,39 +787,289 @@ public:
     void clearColumn(int index);
     bool isColumnBarLine(int index) const;
 
+    // Range editing on the current part. Ranges are half-open and clipped to
+    // the part; each call is a single pass over the cells, one undo step and
+    // one notification.
+    TabCellBlock copyRange(juce::Range<int> columns, juce::Range<int> strings) const;
+    void pasteRange(int column, int stringIndex, const TabCellBlock& block);
+    void clearRange(juce::Range<int> columns, juce::Range<int> strings);
+    void shiftFrets(juce::Range<int> columns, juce::Range<int> strings, int semitones);
+    void setTechniqueRange(juce::Range<int> columns, juce::Range<int> strings, Technique tech, bool beforeFret = false);
+
+    // Inserts a copy of the columns, bar lines included, straight after them
+    void duplicateColumns(juce::Range<int> columns);
+
+    // Snapshots. Taking one is O(1) and safe from any thread; the snapshot
+    // never changes, however the engine is edited afterwards.
+    using Snapshot = std::shared_ptr<const TabDocument>;
+    Snapshot getSnapshot() const;
+
+    // Undo/redo. Each outermost transaction, or each edit made outside one,
+    // is one step.
+    bool canUndo() const { return !journal.undoStack.steps.empty(); }
+    bool canRedo() const { return !journal.redoStack.steps.empty(); }
+    bool undo();
+    bool redo();
+    void clearUndoHistory();
+
+    // Undo and redo each drop their furthest steps once they hold more than
+    // this; the nearest step of each is always kept
+    void setUndoMemoryLimit(size_t bytes);
+    size_t getUndoMemoryUsage() const { return journal.undoStack.bytes + journal.redoStack.bytes; }
+
     // Save/Load
+    // Called now and then during a long load or save with how far it has got,
+    // from 0 to 1. Returning false cancels it.
+    using ProgressCallback = std::function<bool (double progress)>;
+
     std::unique_ptr<juce::XmlElement> saveToXML() const;
+    static std::unique_ptr<juce::XmlElement> saveToXML(const TabDocument& doc);
     void loadFromXML(const juce::XmlElement& xml);
 
-    // Export to text
-    juce::String exportToText() const;
+    // Reads a .tabsaver file straight off a stream, without building a DOM.
+    // readFromStream returns nullptr as soon as the data turns out not to be
+    // a well-formed TabData file; loadFromStream then leaves the document alone.
+    bool loadFromStream(juce::InputStream& input);
+    static std::shared_ptr<TabDocument> readFromStream(juce::InputStream& input, const ProgressCallback& progress = nullptr);
+
+    // .tabsaver files. Files are saved in the binary container format, which
+    // indexes its sections so that opening one maps the file and decodes only
+    // the current section; the others are decoded when first selected. Older
+    // XML files are still read, through loadFromStream. Sections that were
+    // never decoded are saved as the bytes they were read from.
+    bool saveToFile(const juce::File& file);
+    static bool writeContainer(const TabDocument& doc, juce::OutputStream& output, const ProgressCallback& progress = nullptr);
+    bool loadFromFile(const juce::File& file);
+
+    // The same, split so the slow part can run on a background thread.
+    // readFile and writeFile don't touch the engine: readFile builds a new
+    // document for loadDocument to swap in on the message thread, and
+    // writeFile saves a snapshot. writeFile writes to a temporary file and
+    // renames it over the target, so a failed or cancelled save leaves any
+    // existing file as it was. Both give up, returning nullptr or false, as
+    // soon as the progress callback returns false.
+    static std::shared_ptr<TabDocument> readFile(const juce::File& file, const ProgressCallback& progress = nullptr);
+    static bool writeFile(const TabDocument& doc, const juce::File& file, const ProgressCallback& progress = nullptr);
+    void loadDocument(std::shared_ptr<TabDocument> loaded);
+
+    // Saving over a file that sections are still read from. Their nodes, in
+    // the document and the undo history, hold a mapping of it, which has to be
+    // let go before the file can be replaced. prepareSave snapshots the
+    // document and collects those nodes on the message thread. SaveJob::write
+    // runs on any thread: it copies their bytes into memory, without decoding
+    // them, and writes the snapshot to a temporary file. finishSave, back on
+    // the message thread, swaps the copies into the engine and only then
+    // renames the temporary file over the target.
+    class SaveJob
+    {
+    public:
+        bool write(const ProgressCallback& progress = nullptr);
+
+        // Sections found unreadable when they were decoded. Sections that
+        // were never decoded are saved as they are, without being checked.
+        int getNumUnreadableSections() const { return numUnreadable; }
+
+    private:
+        friend class TabEngine;
+
+        juce::File file;
+        Snapshot snapshot;
+        std::vector<std::shared_ptr<TabSection>> history;
+        std::map<const TabSection*, std::shared_ptr<TabSection>> copies;
+        std::unique_ptr<juce::TemporaryFile> temp;
+        int numUnreadable = 0;
+    };
+
+    std::shared_ptr<SaveJob> prepareSave(const juce::File& file) const;
+    bool finishSave(SaveJob& job);
+
+    // True if the section's data couldn't be read, and it hasn't been edited
+    // since
+    bool isSectionUnreadable(int sectionIndex) const;
+
+    // Compact binary form for plugin state. Columns that repeat, within a
+    // part or across parts and sections, are stored once, and loading shares
+    // their storage again. Saving reuses the encoding of any part that hasn't
+    // changed since the last save, so it can be called from any thread.
+    // loadFromBinary returns false and leaves the document alone if the data
+    // isn't valid binary state. Damage inside one section only makes that
+    // section unreadable.
+    //
+    // The result can also be deflated. Compressed state has its own magic
+    // number, so isBinaryState and loadFromBinary accept either form.
+    enum class StateCompression
+    {
+        none,
+        fast,   // zlib level 1
+        small   // zlib level 9
+    };
+
+    void saveToBinary(juce::MemoryBlock& destData, StateCompression compression = StateCompression::none) const;
+    static void saveToBinary(const TabDocument& doc, juce::MemoryBlock& destData, StateCompression compression = StateCompression::none);
+    bool loadFromBinary(const void* data, size_t sizeInBytes);
+    static bool isBinaryState(const void* data, size_t sizeInBytes);
+
+    // Export to text. With a wrap width, each part is broken into systems
+    // whose lines are at most that many characters long, at bar lines where
+    // possible; 0 leaves every string on one line.
+    juce::String exportToText(int wrapWidth = 0) const;
+    static juce::String exportToText(const TabDocument& doc, int wrapWidth = 0);
+
+    // Writes the same text as exportToText as UTF-8, without building it in
+    // memory first
+    static void writeText(const TabDocument& doc, juce::OutputStream& out, int wrapWidth = 0);
+
+    // Caps how many threads, counting the calling one, loading XML and text
+    // export spread their work over. 0, the default, leaves it to the number
+    // of cores. It applies to every TabEngine and is mostly for measuring.
+    static void setMaxThreads(int numThreads);
+
+    // Groups any number of edits so that listeners hear about them once, when
+    // the outermost transaction goes out of scope. Transactions can be nested.
+    class ScopedTransaction
+    {
+    public:
+        explicit ScopedTransaction(TabEngine& e) : engine(e) { ++engine.transactionDepth; }
+        ~ScopedTransaction() { engine.endTransaction(); }
+
+    private:
+        TabEngine& engine;
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedTransaction)
+    };
 
-    // Listeners
+    // Listeners. Notifications are delivered asynchronously on the message
+    // thread, so any number of edits made before the next message loop pass
+    // collapse into a single callback.
     class Listener
     {
     public:
         virtual ~Listener() = default;
-        virtual void tabDataChanged() = 0;
+        virtual void tabDataChanged(const TabChange& change) = 0;
     };
 
     void addListener(Listener* listener);
     void removeListener(Listener* listener);
 
 private:
-    int numStrings;
-    juce::String rootNote;
-    TuningType tuningType;
-    GuitarTuning customTuning;
-    std::vector<TabSection> sections;
-    int currentSectionIndex;
-    int currentPartIndex;
+    // Only the message thread edits the document. Edits and snapshots both
+    // take documentLock, so an edit never changes a node a snapshot can see.
+    std::shared_ptr<TabDocument> document;
+    mutable juce::SpinLock documentLock;
     juce::ListenerList<Listener> listeners;
+    TabJournal journal;
+    int transactionDepth = 0;
+    bool notificationPending = false;
+    TabChange pendingChange; // Guarded by documentLock
+
+    // Binary encodings of the parts in the last saved state, keyed by node,
+    // with the end of each window of columns. The node is held so its
+    // address can't be reused by a new one.
+    struct EncodedPart
+    {
+        std::shared_ptr<const TabPart> part;
+        juce::MemoryBlock bytes;
+        std::vector<size_t> windowEnds;
+    };
+
+    using PartEncodings = std::map<const TabPart*, EncodedPart>;
+
+    mutable PartEncodings encodedParts; // Guarded by encodedPartsLock
+    mutable juce::CriticalSection encodedPartsLock;
+
+    static void writeState(const TabDocument& doc, juce::MemoryBlock& destData,
+                           const std::function<const EncodedPart& (const std::shared_ptr<TabPart>&)>& encodingOf);
+
+    // Text of the parts in the last export, keyed by node like encodedParts,
+    // with the end of each string's line. The tuning and string count they
+    // were rendered with are kept, as those name the lines. The bar lines and
+    // column widths stay the same for as long as the node does, so a part
+    // can be wrapped to a new width without measuring its columns again.
+    struct RenderedPart
+    {
+        std::shared_ptr<const TabPart> part;
+        GuitarTuning tuning;
+        int numStrings = 0;
+        int wrapWidth = 0;
+        juce::MemoryBlock text;
+        std::vector<size_t> lineEnds;
+        std::vector<bool> barLines;
+        std::vector<juce::uint8> columnWidths; // Only measured once wrapped
+    };
+
+    using PartRenderings = std::map<const TabPart*, RenderedPart>;
+
+    // Sections that were still encoded in the last export, decoded and keyed
+    // by the encoded node, which is held so the key stays valid. Their parts
+    // stay the same nodes from one export to the next, so their renderings
+    // are found again rather than every untouched section of a file opened
+    // lazily being decoded and rendered on each export.
+    struct DecodedSection
+    {
+        std::shared_ptr<const TabSection> encoded;
+        std::shared_ptr<const TabSection> section;
+        int numStrings = 0;
+    };
+
+    using SectionDecodings = std::map<const TabSection*, DecodedSection>;
+
+    struct TextRenderings
+    {
+        PartRenderings parts;
+        SectionDecodings sections;
+    };
+
+    mutable TextRenderings renderedText; // Guarded by renderedTextLock
+    mutable juce::CriticalSection renderedTextLock;
+
+    // Renders the parts not in rendered yet, taking them from cache where it
+    // has them, then writes the text with the parts in document order
+    static void writeText(const TabDocument& doc, juce::OutputStream& out, int wrapWidth,
+                          TextRenderings& rendered, TextRenderings* cache);
+
+    void notifyListeners(const TabChange& change);
+    TabChange cellsInCurrentPart(juce::Range<int> columns, juce::Range<int> strings) const;
+    TabChange columnsInCurrentPart(int firstColumn) const;
+    void endTransaction();
+    void handleAsyncUpdate() override;
+    static void updateTuning(TabDocument& doc);
+    static int retune(const TabDocument& from, TabDocument& to);
+    int commitRetuned(std::shared_ptr<TabDocument> edited);
+    std::shared_ptr<TabDocument> commitDocument(std::shared_ptr<TabDocument> newDocument);
+    static void prepareLoadedDocument(TabDocument& doc);
+
+    template <typename Element>
+    static void readDocumentAttributes(TabDocument& doc, const Element& element);
+    static std::shared_ptr<TabDocument> readBinary(const juce::uint8* data, size_t sizeInBytes, std::shared_ptr<const void> owner,
+                                                   const ProgressCallback& progress = nullptr);
+
+    // Sections opened lazily. The current section is always decoded; decoded()
+    // returns the section itself if it is, or a decoded copy if not. A section
+    // that can't be decoded comes back empty, holding on to its bytes.
+    static std::shared_ptr<TabSection> decoded(const std::shared_ptr<TabSection>& section, int numStrings);
+    void decodeCurrentSection();
+    static void validateSelection(TabDocument& doc);
+
+    // Shares the part if it already has numStrings strings, otherwise copies
+    // it string by string
+    static std::shared_ptr<TabPart> withNumStrings(const std::shared_ptr<TabPart>& part, int numStrings);
+
+    // Journal helpers
+    TabJournal::Record makeRecord(TabJournal::Op op, int sectionIndex, int partIndex = 0, int column = 0) const;
+    void recordCell(int columnIndex, int stringIndex);
+
+    template <typename EditFn>
+    void editRange(juce::Range<int> columns, juce::Range<int> strings, EditFn&& edit);
+    bool replay(TabJournal::Stack& from, TabJournal::Stack& to);
+    TabChange revert(TabJournal::Record& record, std::shared_ptr<void>& node);
+
+    // Copy-on-write access; call with documentLock held
+    TabDocument& editDocument();
+    TabSection& editSection(int sectionIndex);
+    TabPart& editPart(int sectionIndex, int partIndex);
+    TabPart* editCurrentPart();
 
-    void notifyListeners();
-    void updateTuning();
-    TabSection* getCurrentSectionPtr();
     const TabSection* getCurrentSectionPtr() const;
-    TabPart* getCurrentPartPtr();
     const TabPart* getCurrentPartPtr() const;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TabEngine)
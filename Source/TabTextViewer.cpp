@@ -0,0 +1,287 @@
+#include "TabTextViewer.h"
+
+TabTextViewer::TabTextViewer()
+    : font(juce::FontOptions(juce::Font::getDefaultMonospacedFontName(), 14.0f, juce::Font::plain)),
+      charWidth(juce::GlyphArrangement::getStringWidth(font, "0")),
+      lineHeight((int)std::ceil(font.getHeight())),
+      margin(4)
+{
+    setWantsKeyboardFocus(true);
+    setMouseCursor(juce::MouseCursor::IBeamCursor);
+    setText({});
+}
+
+TabTextViewer::~TabTextViewer()
+{
+}
+
+void TabTextViewer::setText(const juce::String& newText)
+{
+    text = newText;
+    lines.clear();
+    longestLine = 0;
+
+    // Index where every line starts, counting characters (not bytes) as
+    // they go so columns line up on lines with non-ASCII names
+    auto* data = text.toRawUTF8();
+    int start = 0;
+    int numChars = 0;
+
+    for (int i = 0;; ++i)
+    {
+        auto c = (juce::uint8)data[i];
+
+        if (c == '\n' || c == 0)
+        {
+            lines.push_back({ start, i - start, numChars });
+            longestLine = juce::jmax(longestLine, numChars);
+
+            if (c == 0)
+                break;
+
+            start = i + 1;
+            numChars = 0;
+        }
+        else if ((c & 0xc0) != 0x80)
+        {
+            ++numChars;
+        }
+    }
+
+    // Keep the glyphs of lines that read the same as before, so an edit only
+    // lays out the lines it changed
+    for (auto it = cachedLines.begin(); it != cachedLines.end();)
+    {
+        if (it->first < (int)lines.size() && getLineText(it->first, it->second.columns) == it->second.text)
+            ++it;
+        else
+            it = cachedLines.erase(it);
+    }
+
+    auto clamp = [this](Position position)
+    {
+        position.line = juce::jlimit(0, (int)lines.size() - 1, position.line);
+        position.column = juce::jlimit(0, lines[(size_t)position.line].numChars, position.column);
+        return position;
+    };
+
+    selectionAnchor = clamp(selectionAnchor);
+    caret = clamp(caret);
+
+    updateSize();
+    repaint();
+}
+
+juce::String TabTextViewer::getSelectedText() const
+{
+    auto start = juce::jmin(selectionAnchor, caret);
+    auto end = juce::jmax(selectionAnchor, caret);
+
+    return juce::String(juce::CharPointer_UTF8(getAddress(start.line, start.column)),
+                        juce::CharPointer_UTF8(getAddress(end.line, end.column)));
+}
+
+void TabTextViewer::selectAll()
+{
+    selectionAnchor = {};
+    caret = { (int)lines.size() - 1, lines.back().numChars };
+    repaint();
+}
+
+void TabTextViewer::copy()
+{
+    if (selectionAnchor != caret)
+        juce::SystemClipboard::copyTextToClipboard(getSelectedText());
+}
+
+void TabTextViewer::paint(juce::Graphics& g)
+{
+    g.fillAll(juce::Colour(0xff1a1a1a)); // Dark background
+
+    // Only visit the lines and columns that overlap the area being repainted
+    auto clip = g.getClipBounds();
+    int numLines = (int)lines.size();
+    int firstLine = juce::jlimit(0, numLines, (clip.getY() - margin) / lineHeight);
+    int lastLine = juce::jlimit(0, numLines, (clip.getBottom() - margin) / lineHeight + 1);
+    int firstColumn = juce::jmax(0, (int)((float)(clip.getX() - margin) / charWidth));
+    int lastColumn = juce::jmax(0, (int)((float)(clip.getRight() - margin) / charWidth) + 1);
+
+    // Draw selection
+    auto start = juce::jmin(selectionAnchor, caret);
+    auto end = juce::jmax(selectionAnchor, caret);
+
+    if (start != end)
+    {
+        g.setColour(juce::Colour(0xff264f78));
+
+        for (int line = juce::jmax(firstLine, start.line); line < lastLine && line <= end.line; ++line)
+        {
+            // Lines the selection runs past include their line break
+            int from = line == start.line ? start.column : 0;
+            int to = line == end.line ? end.column : lines[(size_t)line].numChars + 1;
+
+            g.fillRect((float)margin + (float)from * charWidth, (float)(margin + line * lineHeight),
+                       (float)(to - from) * charWidth, (float)lineHeight);
+        }
+    }
+
+    // Draw text. Glyphs are laid out for a screen's width of columns either
+    // side of the visible ones, so short horizontal scrolls reuse them too.
+    g.setColour(juce::Colours::lightgrey);
+
+    int extraColumns = lastColumn - firstColumn;
+    juce::Range<int> visibleColumns(firstColumn, lastColumn);
+
+    for (int line = firstLine; line < lastLine; ++line)
+    {
+        juce::Range<int> lineColumns(0, lines[(size_t)line].numChars);
+        auto wanted = visibleColumns.getIntersectionWith(lineColumns);
+
+        if (wanted.isEmpty())
+            continue;
+
+        auto& cached = cachedLines[line];
+
+        if (!cached.columns.contains(wanted))
+        {
+            cached.columns = juce::Range<int>(firstColumn - extraColumns, lastColumn + extraColumns).getIntersectionWith(lineColumns);
+            cached.text = getLineText(line, cached.columns);
+            cached.glyphs.clear();
+            cached.glyphs.addLineOfText(font, cached.text,
+                                        (float)margin + (float)cached.columns.getStart() * charWidth,
+                                        (float)(margin + line * lineHeight) + font.getAscent());
+        }
+
+        cached.glyphs.draw(g);
+    }
+
+    // Forget lines that are more than a screen away
+    int extraLines = lastLine - firstLine;
+
+    cachedLines.erase(cachedLines.begin(), cachedLines.lower_bound(firstLine - extraLines));
+    cachedLines.erase(cachedLines.upper_bound(lastLine + extraLines), cachedLines.end());
+}
+
+void TabTextViewer::parentSizeChanged()
+{
+    updateSize();
+}
+
+void TabTextViewer::updateSize()
+{
+    int width = margin * 2 + (int)std::ceil((float)longestLine * charWidth);
+    int height = margin * 2 + (int)lines.size() * lineHeight;
+
+    // Cover the whole viewport when the text is smaller than it
+    if (auto* parent = getParentComponent())
+    {
+        width = juce::jmax(width, parent->getWidth());
+        height = juce::jmax(height, parent->getHeight());
+    }
+
+    setSize(width, height);
+}
+
+bool TabTextViewer::keyPressed(const juce::KeyPress& key)
+{
+    if (key == juce::KeyPress('c', juce::ModifierKeys::commandModifier, 0))
+    {
+        copy();
+        return true;
+    }
+
+    if (key == juce::KeyPress('a', juce::ModifierKeys::commandModifier, 0))
+    {
+        selectAll();
+        return true;
+    }
+
+    return false;
+}
+
+void TabTextViewer::mouseDown(const juce::MouseEvent& event)
+{
+    if (event.mods.isPopupMenu())
+    {
+        juce::PopupMenu menu;
+        menu.addItem(1, "Copy", selectionAnchor != caret);
+        menu.addItem(2, "Select All");
+
+        menu.showMenuAsync(juce::PopupMenu::Options(), [this](int result)
+        {
+            switch (result)
+            {
+                case 1: copy(); break;
+                case 2: selectAll(); break;
+            }
+        });
+
+        return;
+    }
+
+    setCaret(getPositionAt(event.getPosition()), event.mods.isShiftDown());
+
+    // Keeps mouseDrag coming while the mouse is held still outside the
+    // viewport, so the view carries on scrolling
+    beginDragAutoRepeat(50);
+}
+
+void TabTextViewer::mouseDrag(const juce::MouseEvent& event)
+{
+    if (event.mods.isPopupMenu())
+        return;
+
+    setCaret(getPositionAt(event.getPosition()), true);
+
+    if (auto* viewport = findParentComponentOfClass<juce::Viewport>())
+    {
+        auto position = viewport->getLocalPoint(this, event.getPosition());
+        viewport->autoScroll(position.x, position.y, 20, 10);
+    }
+}
+
+const char* TabTextViewer::getAddress(int line, int column) const
+{
+    const auto& info = lines[(size_t)line];
+    auto* start = text.toRawUTF8() + info.start;
+    column = juce::jlimit(0, info.numChars, column);
+
+    if (info.numBytes == info.numChars)
+        return start + column;
+
+    juce::CharPointer_UTF8 address(start);
+    address += column;
+    return address.getAddress();
+}
+
+juce::String TabTextViewer::getLineText(int line, juce::Range<int> columns) const
+{
+    return juce::String(juce::CharPointer_UTF8(getAddress(line, columns.getStart())),
+                        juce::CharPointer_UTF8(getAddress(line, columns.getEnd())));
+}
+
+TabTextViewer::Position TabTextViewer::getPositionAt(juce::Point<int> point) const
+{
+    Position position;
+    position.line = juce::jlimit(0, (int)lines.size() - 1, (point.y - margin) / lineHeight);
+    position.column = juce::jlimit(0, lines[(size_t)position.line].numChars,
+                                   juce::roundToInt((float)(point.x - margin) / charWidth));
+    return position;
+}
+
+void TabTextViewer::setCaret(Position newCaret, bool extendSelection)
+{
+    auto oldStart = juce::jmin(selectionAnchor, caret);
+    auto oldEnd = juce::jmax(selectionAnchor, caret);
+
+    caret = newCaret;
+
+    if (!extendSelection)
+        selectionAnchor = caret;
+
+    // Only the lines whose highlight could have changed need repainting
+    int firstLine = juce::jmin(oldStart.line, selectionAnchor.line, caret.line);
+    int lastLine = juce::jmax(oldEnd.line, selectionAnchor.line, caret.line);
+
+    repaint(0, margin + firstLine * lineHeight, getWidth(), (lastLine - firstLine + 1) * lineHeight);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+// Read-only view of exported tab text, meant to sit inside a Viewport. Lines
+// are found through an index of where each one starts, and only the lines and
+// columns overlapping the area being repainted are drawn. Their glyphs are
+// laid out once and kept while they stay near the screen, so scrolling stays
+// smooth however long the song is. Text can be selected with the mouse and
+// copied.
+class TabTextViewer : public juce::Component
+{
+public:
+    TabTextViewer();
+    ~TabTextViewer() override;
+
+    void setText(const juce::String& newText);
+    const juce::String& getText() const { return text; }
+
+    // Selection
+    juce::String getSelectedText() const;
+    void selectAll();
+    void copy();
+
+    void paint (juce::Graphics&) override;
+    void parentSizeChanged() override;
+
+    // Keyboard and mouse input
+    bool keyPressed(const juce::KeyPress& key) override;
+    void mouseDown(const juce::MouseEvent& event) override;
+    void mouseDrag(const juce::MouseEvent& event) override;
+
+    // Size calculation
+    void updateSize();
+    int getNumColumnsFitting(int width) const { return (int)((float)(width - margin * 2) / charWidth); }
+
+private:
+    // Where a line starts in the text and how long it is, in bytes and in
+    // characters. The two only differ on lines holding non-ASCII names.
+    struct Line
+    {
+        int start = 0;
+        int numBytes = 0;
+        int numChars = 0;
+    };
+
+    // A place between two characters, as used by the selection
+    struct Position
+    {
+        int line = 0;
+        int column = 0;
+
+        bool operator==(const Position& other) const { return line == other.line && column == other.column; }
+        bool operator!=(const Position& other) const { return !(*this == other); }
+        bool operator<(const Position& other) const { return line < other.line || (line == other.line && column < other.column); }
+    };
+
+    // Glyphs for some of one line's columns, with the text they came from
+    struct CachedLine
+    {
+        juce::Range<int> columns;
+        juce::String text;
+        juce::GlyphArrangement glyphs;
+    };
+
+    juce::String text;
+    std::vector<Line> lines;
+    int longestLine = 0; // In characters
+
+    // Display settings
+    juce::Font font;
+    float charWidth;
+    int lineHeight;
+    int margin;
+
+    Position selectionAnchor;
+    Position caret;
+
+    std::map<int, CachedLine> cachedLines;
+
+    // Helper methods
+    const char* getAddress(int line, int column) const;
+    juce::String getLineText(int line, juce::Range<int> columns) const;
+    Position getPositionAt(juce::Point<int> point) const;
+    void setCaret(Position newCaret, bool extendSelection);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TabTextViewer)
+};
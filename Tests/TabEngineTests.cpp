@@ -0,0 +1,102 @@
+#include "TabEngine.h"
+
+//==============================================================================
+// Plugin state comes from the host and files from anywhere, so damaged or
+// crafted data has to be turned away without reading outside it.
+class BinaryStateTests : public juce::UnitTest
+{
+public:
+    BinaryStateTests() : juce::UnitTest("Binary state", "TabEngine") {}
+
+    void runTest() override
+    {
+        beginTest("Round trip");
+        {
+            TabEngine source;
+            source.setFret(0, 0, 3);
+            source.addSection("Verse");
+
+            juce::MemoryBlock state;
+            source.saveToBinary(state);
+
+            TabEngine loaded;
+            expect(loaded.loadFromBinary(state.getData(), state.getSize()));
+            expectEquals(loaded.getNumSections(), 2);
+            expectEquals(loaded.getFret(0, 0), 3);
+        }
+
+        beginTest("Part that refers to an empty window table");
+        {
+            // A string table holding one name, no windows, then one part of
+            // 10 columns whose first window index has nothing to point at
+            auto state = makeState(3, { 1, 1, 'A', 0, 1, 0, 10, 0 });
+            expect(!TabEngine().loadFromBinary(state.getData(), state.getSize()));
+        }
+
+        beginTest("Section that refers to an empty part table");
+        {
+            // A string table holding one name, no windows or parts, then one
+            // section listing one part
+            auto state = makeState(3, { 1, 1, 'A', 0, 0, 0, 0, 1, 0 });
+            expect(!TabEngine().loadFromBinary(state.getData(), state.getSize()));
+        }
+
+        beginTest("Damaged section in per-section state");
+        {
+            // One section (version 1) whose bytes don't decode. The rest of
+            // the state is fine, so it loads, keeping that section's bytes.
+            auto state = makeState(1, { 3, 0xff, 0xff, 0xff });
+
+            TabEngine loaded;
+            expect(loaded.loadFromBinary(state.getData(), state.getSize()));
+            expectEquals(loaded.getNumSections(), 1);
+            expect(loaded.isSectionUnreadable(0));
+        }
+    }
+
+private:
+    // State of the given version for one 6-string section in standard
+    // tuning, followed by body
+    static juce::MemoryBlock makeState(juce::uint8 version, std::initializer_list<juce::uint8> body)
+    {
+        juce::MemoryOutputStream out;
+        out.write("TABS", 4);
+
+        const juce::uint8 header[] = { version,
+                                       6, 4, 0, 0, 0,         // Strings, root, tuning type, section, part
+                                       6, 40, 45, 50, 55, 59, 64,
+                                       1,                     // Chunks
+                                       1 };                   // Sections
+        out.write(header, sizeof(header));
+
+        for (auto byte : body)
+            out.writeByte((char)byte);
+
+        // Room for the counts that are checked against the bytes left
+        for (int i = 0; i < 8; ++i)
+            out.writeByte(0);
+
+        return out.getMemoryBlock();
+    }
+};
+
+static BinaryStateTests binaryStateTests;
+
+//==============================================================================
+int main()
+{
+    // TabEngine's change notifications are posted to the message thread
+    juce::MessageManager::getInstance();
+
+    juce::UnitTestRunner runner;
+    runner.runTestsInCategory("TabEngine");
+
+    int numFailures = 0;
+    for (int i = 0; i < runner.getNumResults(); ++i)
+        numFailures += runner.getResult(i)->failures;
+
+    // Stops the shared worker threads, as shutting JUCE down in a host would
+    juce::DeletedAtShutdown::deleteAll();
+    juce::MessageManager::deleteInstance();
+    return numFailures > 0 ? 1 : 0;
+}